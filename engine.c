@@ -7,16 +7,119 @@
 #include <string.h>
 #include <limits.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#define HOST_DEVICE 0
+#define HOST_SWAPCHAIN 1
+#define HOST_PIPELINE 2
+#define HOST_TEXTURE 3
+#define HOST_GEOMETRY 4
+#define HOST_FRAME 5
+#define HOST_TAGS 6
+#define HOST_ARENA (1 << 20)
+
+#include "libraries/host_memory.h"
+
+#define STBI_MALLOC(size) allocateHost(HOST_TEXTURE, size)
+#define STBI_REALLOC(pointer, size) reallocateHost(HOST_TEXTURE, pointer, size)
+#define STBI_FREE(pointer) freeHost(pointer)
+#define TINYOBJ_MALLOC(size) allocateHost(HOST_GEOMETRY, size)
+#define TINYOBJ_REALLOC(pointer, size) reallocateHost(HOST_GEOMETRY, pointer, size)
+#define TINYOBJ_CALLOC(count, size) allocateHostZeroed(HOST_GEOMETRY, count, size)
+#define TINYOBJ_FREE(pointer) freeHost(pointer)
+#define JPEG_MALLOC(size) allocateHost(HOST_TEXTURE, size)
+#define JPEG_CALLOC(count, size) allocateHostZeroed(HOST_TEXTURE, count, size)
+#define JPEG_FREE(pointer) freeHost(pointer)
 #define STBI_ASSERT(x)
 #define STB_IMAGE_IMPLEMENTATION
 #define TINYOBJ_LOADER_C_IMPLEMENTATION
 #include "libraries/stb_image.h"
 #include "libraries/tinyobj_loader_c.h"
+#include "libraries/jpeg_reduce.h"
+
+#define VIRTUAL_PAGE 128
+#define VIRTUAL_BORDER 4
+#define VIRTUAL_SLOT (VIRTUAL_PAGE + 2 * VIRTUAL_BORDER)
+#define VIRTUAL_SLOTS 16
+#define VIRTUAL_LEVELS 12
+#define VIRTUAL_UPLOADS 16
+#define VIRTUAL_QUEUE 256
+#define FEEDBACK_SCALE 8
+#define RESIDENCY_TEXTURES 2
+#define RESIDENCY_LEVELS 32
+#define RESIDENCY_MINIMUM 128
+#define RESIDENCY_BUDGET (32 << 20)
+#define RESIDENCY_DELAY 120
+#define RESIDENCY_EXTENT 2.0f
+#define RESIDENCY_REDUCTION 3
+#define ATLAS_SIZE 2048
+#define ATLAS_LIMIT 256
+#define ATLAS_LEVELS 4
+#define ATLAS_PADDING (2 << (ATLAS_LEVELS - 1))
+#define ATLAS_PAGES 8
+#define ATLAS_ENTRIES 256
+#define ATLAS_MAGIC 0x534C5441
+#define ATLAS_VERSION 1
+#define ATLAS_CACHE "textures/atlas.cache"
+#define PIPELINE_CACHE "shaders/pipeline_%04x_%04x.cache"
+#define MIPMAP_LEVELS 4
+#define MIPMAP_GROUP 16
+#define MIPMAP_BATCH 16
+#define MIPMAP_BOX 0
+#define MIPMAP_KAISER 1
+#define MEMORY_BLOCK (64 << 20)
+#define MEMORY_MINIMUM 256
+#define MEMORY_ORDERS 19
+#define MEMORY_INTERVAL 120
+#define MEMORY_PRESSURE 0.9
+#define MEMORY_CALLBACKS 8
+#define MEMORY_TEXTURE 0
+#define MEMORY_GEOMETRY 1
+#define MEMORY_ATTACHMENT 2
+#define MEMORY_STAGING 3
+#define MEMORY_FRAME 4
+#define MEMORY_CATEGORIES 5
+#define RING_FRAME (256 << 10)
+#define OBJECT_MINIMUM 1024
+#define FRAMES_IN_FLIGHT 2
+#define FRAMES_MAXIMUM 8
+#define RECORD_THREADS 8
+#define PIPELINE_VARIANTS 8
+#define SWAPCHAIN_RETIRED 4
+#define LATENCY_MARGIN 0.0005
+#define LATENCY_SMOOTHING 0.1
+#define PRESENT_TIMEOUT 100000000
+#define RECORD_PARTITION 256
+#define GEOMETRY_VERTICES (1 << 20)
+#define GEOMETRY_INDICES (1 << 22)
+#define GEOMETRY_STAGING (4 << 20)
+#define MESH_FREE 0
+#define MESH_PENDING 1
+#define MESH_READY 2
+#define DEFRAG_BUDGET (2 << 20)
+#define DEFRAG_THRESHOLD 0.25
+#define DEFRAG_SPARSE 0.25
+#define CHURN_MESHES 64
+#define CHURN_VERTICES 4096
+#define CHURN_FRAMES 600
+#define MEMORY_DIRECT (VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | \
+ VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+#define UPLOAD_BENCHMARK (64 << 20)
+#define UPLOAD_RING (32 << 20)
+#define UPLOAD_BATCHES 4
+#define UPLOAD_ALIGNMENT 16
+#define HANDLE_BITS 20
+#define HANDLE_SLOT ((1 << HANDLE_BITS) - 1)
+#define HANDLE_GENERATIONS ((1 << (32 - HANDLE_BITS)) - 1)
+#define HANDLE_NULL 0
+#define HANDLE_COLUMNS 3
+#define HANDLE_INITIAL 16
+#define BENCHMARK_FRAMES 1800
 
 union vertex
 {
@@ -42,6 +145,183 @@ struct uniformBufferObject
 	float model[16];
 	float view[16];
 	float proj[16];
+	uint32_t feedback[4];
+	uint32_t residency[4];
+};
+
+struct objectBufferObject
+{
+	uint32_t mode, layer;
+};
+
+struct virtualPage
+{
+	int32_t slot;
+	uint32_t used;
+	uint8_t pending;
+};
+
+struct virtualSlot
+{
+	int32_t page, prev, next;
+};
+
+struct virtualTile
+{
+	uint32_t page;
+	uint8_t *pixels;
+};
+
+struct handleTable
+{
+	const char *name;
+	uint32_t tag, count, limit, free, live;
+	uint32_t *generations, *next;
+	uint32_t columnCount;
+	void **columns[HANDLE_COLUMNS];
+	size_t sizes[HANDLE_COLUMNS];
+	void (*destroy)(uint32_t slot);
+};
+
+struct handleRelease
+{
+	struct handleTable *table;
+	uint32_t handle;
+	uint64_t frame;
+};
+
+struct uploadBatch
+{
+	VkCommandBuffer transfer, graphics;
+	uint32_t transferred, recorded;
+	VkDeviceSize head;
+	uint32_t bufferCount, bufferLimit;
+	uint32_t *buffers;
+	uint32_t viewCount, viewLimit;
+	VkImageView *views;
+	uint32_t poolCount, poolLimit;
+	VkDescriptorPool *pools;
+};
+
+struct computeFrame
+{
+	VkCommandBuffer commandBuffer;
+	uint32_t recorded, submitted;
+	uint64_t transferValue;
+	uint32_t viewCount, viewLimit;
+	VkImageView *views;
+	uint32_t poolCount, poolLimit;
+	VkDescriptorPool *pools;
+	uint32_t acquireCount, acquireLimit;
+	VkImageMemoryBarrier *acquires;
+};
+
+struct memoryBlock
+{
+	VkDeviceMemory memory;
+	VkDeviceSize size, used;
+	uint32_t type, linear, count;
+	uint8_t *tree;
+	uint8_t *mapped;
+};
+
+struct allocation
+{
+	VkDeviceMemory memory;
+	VkDeviceSize offset, size;
+	uint32_t block, order, category;
+	void *mapped;
+};
+
+struct mipmapRequest
+{
+	VkImage image;
+	VkFormat format;
+	uint32_t width, height, levels, layers;
+	uint32_t filter, srgb;
+};
+
+struct mesh
+{
+	uint32_t firstIndex, indexCount;
+	uint32_t firstVertex, vertexCount;
+	uint32_t mode, layer;
+	int32_t texture;
+	float origin[3];
+	uint32_t state;
+};
+
+struct geometryRange
+{
+	uint32_t offset, count;
+};
+
+struct geometryPool
+{
+	uint32_t buffer;
+	uint8_t *mapped;
+	VkDeviceSize stride;
+	uint32_t capacity, used;
+	uint32_t rangeCount, rangeLimit;
+	struct geometryRange *ranges;
+	uint32_t compacting, moves;
+	VkDeviceSize moved;
+	double fragmentation;
+	uint64_t frame;
+};
+
+struct geometryUpload
+{
+	uint32_t mesh;
+	union vertex *vertices;
+	uint32_t *indices;
+};
+
+struct geometryRelease
+{
+	uint32_t vertexOffset, vertexCount;
+	uint32_t indexOffset, indexCount;
+	uint64_t frame;
+};
+
+struct packedTexture
+{
+	char path[256];
+	int64_t modified;
+	uint32_t width, height;
+	uint32_t layer, x, y;
+};
+
+struct residentTexture
+{
+	uint32_t *texture;
+	VkImageViewType viewType;
+	uint32_t binding, *sampler;
+	const char *path;
+	uint8_t *sources[VIRTUAL_LEVELS];
+	uint32_t width, height, levels, layers, filter;
+	uint32_t resident, minimum, frames;
+	uint32_t requested, coverage;
+	uint32_t pending, pendingLevel;
+	uint64_t pendingSerial;
+	uint32_t stale, committed;
+};
+
+struct recordPartition
+{
+	VkCommandBuffer commandBuffer;
+	uint32_t version, draws;
+};
+
+struct retiredSwapchain
+{
+	VkSwapchainKHR swapchain;
+	VkImageView *views, colorView, depthView;
+	VkFramebuffer *framebuffers;
+	VkImage colorImage, depthImage;
+	struct allocation memory;
+	uint32_t count;
+	uint64_t value;
 };
 
 struct swapchainDetails
@@ -55,13 +335,36 @@ struct swapchainDetails
 typedef union vertex Vertex;
 typedef struct node Node;
 typedef struct uniformBufferObject UniformBufferObject;
+typedef struct objectBufferObject ObjectBufferObject;
+typedef struct virtualPage VirtualPage;
+typedef struct virtualSlot VirtualSlot;
+typedef struct virtualTile VirtualTile;
+typedef uint32_t Handle;
+typedef struct handleTable HandleTable;
+typedef struct handleRelease HandleRelease;
+typedef struct uploadBatch UploadBatch;
+typedef struct computeFrame ComputeFrame;
+typedef struct memoryBlock MemoryBlock;
+typedef struct allocation Allocation;
+typedef struct mipmapRequest MipmapRequest;
+typedef struct mesh Mesh;
+typedef struct geometryRange GeometryRange;
+typedef struct geometryPool GeometryPool;
+typedef struct geometryUpload GeometryUpload;
+typedef struct geometryRelease GeometryRelease;
+typedef struct packedTexture PackedTexture;
+typedef struct residentTexture ResidentTexture;
+typedef struct recordPartition RecordPartition;
+typedef struct retiredSwapchain RetiredSwapchain;
 typedef struct swapchainDetails SwapchainDetails;
+typedef void (*MemoryCallback)(uint32_t heap, VkDeviceSize usage, VkDeviceSize budget);
 
 GLFWwindow* window;
-int width, height, focus, ready;
+int width, height, focus, ready, benchmark, churn, staging, sharedQueues, lowLatency, renderPasses;
+uint32_t frameCount;
 int keyW, keyA, keyS, keyD, keyR, keyF;
 double moveX, moveY, mouseX, mouseY;
-int fillMode, cullMode;
+int fillMode, cullMode, depthMode;
 float up[4], forward[4], position[4];
 Node *hashMap;
 struct timespec timespec, timeorig;
@@ -72,8 +375,19 @@ VkSurfaceKHR surface;
 VkPhysicalDevice physicalDevice;
 SwapchainDetails swapchainDetails;
 VkDevice device;
-uint32_t graphicsIndex, presentIndex;
-VkQueue graphicsQueue, presentQueue;
+uint32_t graphicsIndex, presentIndex, transferIndex, computeIndex;
+VkQueue graphicsQueue, presentQueue, transferQueue, computeQueue;
+VkPhysicalDeviceMemoryProperties memoryProperties;
+MemoryBlock *memoryBlocks;
+uint32_t memoryBlockCount, memorySeparate;
+uint64_t memoryLive, memoryPeak, memoryDevice, memoryCount, memoryRequests;
+uint32_t memoryBudget, memoryReport, memoryCallbackCount, memoryDirect;
+VkDeviceSize memoryHeapUsage[VK_MAX_MEMORY_HEAPS], memoryHeapBudget[VK_MAX_MEMORY_HEAPS];
+VkDeviceSize memoryHeapEngine[VK_MAX_MEMORY_HEAPS];
+VkDeviceSize memoryCategories[MEMORY_CATEGORIES], memoryCategoryPeak[MEMORY_CATEGORIES];
+MemoryCallback memoryCallbacks[MEMORY_CALLBACKS];
+const char *memoryNames[] = {"Texture", "Geometry", "Attachment", "Staging", "Frame"};
+const char *hostNames[] = {"Device", "Swapchain", "Pipeline", "Texture", "Geometry", "Frame"};
 uint32_t framebufferSize, framebufferLimit;
 VkSwapchainKHR swapchain;
 VkFormat swapchainFormat;
@@ -82,37 +396,165 @@ VkImage *swapchainImages;
 VkImageView *swapchainViews;
 VkShaderModule vertexShader, fragmentShader;
 VkRenderPass renderPass;
+VkFormat depthAttachmentFormat;
 VkDescriptorSetLayout descriptorSetLayout;
-VkPipelineLayout pipelineLayout;
-VkPipeline graphicsPipeline;
+Handle graphicsPipeline, pipelineVariants[PIPELINE_VARIANTS];
+uint32_t dynamicState, dynamicPolygon, dynamicRendering, pipelineCurrent, pipelinesPending;
+PFN_vkCmdSetPolygonModeEXT setPolygonMode;
+VkPipeline builtPipelines[PIPELINE_VARIANTS];
+VkPipelineLayout builtLayouts[PIPELINE_VARIANTS];
+pthread_t pipelineBuilder;
+double pipelineStart, pipelineTime, builderTime;
+VkPipelineCache pipelineCache;
+char pipelineCachePath[64];
+size_t pipelineCacheLoaded;
 VkFramebuffer *swapchainFramebuffers;
+RetiredSwapchain retiredSwapchains[SWAPCHAIN_RETIRED];
+uint32_t retiredCount;
 VkDeviceSize vertexCount, vertexLimit, vertexSize;
 VkDeviceSize indexCount, indexLimit, indexSize;
 Vertex *vertices;
 uint32_t *indices;
-VkBuffer vertexBuffer, indexBuffer;
-VkDeviceMemory vertexBufferMemory, indexBufferMemory;
-VkBuffer *uniformBuffers;
-VkDeviceMemory *uniformBufferMemories;
-VkCommandPool commandPool;
-VkCommandBuffer *commandBuffers;
+Mesh *meshes;
+GeometryPool vertexPool, indexPool;
+Handle geometryStaging;
+uint8_t *geometryMapped;
+uint32_t geometrySlots;
+GeometryUpload *geometryUploads;
+GeometryRelease *geometryReleases;
+uint32_t geometryUploadCount, geometryUploadLimit, geometryReleaseCount, geometryReleaseLimit;
+Handle groundMesh;
+uint64_t geometryInserted, geometryRemoved;
+uint64_t defragMoves, defragMoved, defragRelocations;
+uint32_t memoryTarget = UINT32_MAX;
+Handle churnMeshes[CHURN_MESHES];
+HandleTable textureTable, bufferTable, samplerTable, pipelineTable, meshTable;
+VkImage *textureImages;
+VkImageView *textureViews;
+Allocation *textureMemories;
+VkBuffer *bufferObjects;
+Allocation *bufferMemories;
+VkSampler *samplerObjects;
+VkPipeline *pipelineObjects;
+VkPipelineLayout *pipelineLayouts;
+HandleRelease *handleReleases;
+uint32_t handleReleaseCount, handleReleaseLimit;
+uint64_t handlesDeferred;
+uint64_t uploadDirect, uploadStaged, uploadCopies;
+double uploadDirectTime, uploadDirectRate, uploadStagedRate;
+VkCommandPool uploadPool, transferPool;
+VkSemaphore uploadTimeline, transferTimeline;
+UploadBatch uploadBatches[UPLOAD_BATCHES];
+Handle uploadRing;
+uint8_t *uploadMapped;
+VkDeviceSize uploadHead, uploadTail, uploadPeak;
+uint64_t uploadSerial = 1, uploadRetired = 1, uploadSubmits, uploadTransfers, uploadWaits;
+int uploadOpen;
+VkCommandPool computePool;
+VkSemaphore computeTimeline;
+ComputeFrame *computeFrames;
+uint32_t computeSlot;
+uint64_t computeSerial, computeSubmits, computeDispatches;
+Handle ringBuffer, *objectBuffers;
+uint32_t *objectLimits;
+uint8_t *ringMapped;
+VkDeviceSize ringAlignment, ringBase, ringHead, ringPeak;
+VkCommandPool *framePools, *recordPools;
+VkCommandBuffer *frameCommands;
+uint32_t recordThreads, recordFrame, recordOffset;
+void *uniformData;
+VkPipeline recordPipeline;
+VkPipelineLayout recordLayout;
+VkBuffer recordVertices, recordIndices;
+RecordPartition *partitionCache;
+uint32_t partitionCount, partitionLimit, *partitionVersions;
+uint64_t partitionsReused, partitionsRecorded;
+pthread_t *recordWorkers;
+pthread_mutex_t recordMutex;
+pthread_cond_t recordSignal, recordDone;
+uint32_t recordGeneration, recordPending, recordRunning;
+uint64_t recordFrames, recordDraws;
+double recordTime;
 uint32_t mipLevels;
-VkImage textureImage, depthImage, colorImage;
-VkImageView textureView, depthView, colorView;
-VkDeviceMemory textureMemory, depthMemory, colorMemory;
-VkSampler textureSampler;
+Handle textureHandle, textureSampler;
+VkImage depthImage, colorImage;
+VkImageView depthView, colorView;
+Allocation attachmentMemory;
+VkDeviceSize attachmentDepth;
+uint32_t attachmentLazy;
+int mipmapStorage;
+uint32_t mipmapCount;
+MipmapRequest mipmapRequests[MIPMAP_BATCH];
+VkShaderModule mipmapShader;
+VkDescriptorSetLayout mipmapSetLayout;
+Handle mipmapPipeline, mipmapSampler;
 VkSampleCountFlagBits msaaSamples;
 VkDescriptorPool descriptorPool;
 VkDescriptorSet *descriptorSets;
 VkSemaphore *imageAvailable, *renderFinished;
-VkFence *frameFences;
+VkSemaphore frameTimeline;
+uint64_t *frameValues, *imageValues;
+VkPresentModeKHR presentRequest;
+uint32_t presentWait, frameTimestamps;
+PFN_vkWaitForPresentKHR waitForPresent;
+uint64_t presentLast;
+VkQueryPool frameQueries;
+float timestampPeriod;
+double latencyInput, latencyWake, latencySubmit, latencyDisplayed, latencyInterval, latencyGpu, latencyCpu;
+double latencyInputTotal, latencyDisplayTotal;
+uint64_t latencyFrames, latencyDisplays;
+
+uint32_t virtualWidth, virtualPages, virtualLevels, virtualPageCount, virtualPending;
+uint32_t virtualOffsets[VIRTUAL_LEVELS + 1];
+uint8_t *virtualSources[VIRTUAL_LEVELS];
+VirtualPage *virtualTable;
+VirtualSlot virtualSlots[VIRTUAL_SLOTS * VIRTUAL_SLOTS];
+int32_t virtualHead, virtualTail, virtualUnused;
+uint32_t *virtualEntries;
+uint32_t virtualRequests[VIRTUAL_QUEUE], requestHead, requestTail;
+VirtualTile virtualTiles[VIRTUAL_QUEUE];
+uint32_t tileHead, tileTail;
+int virtualRunning;
+pthread_t virtualThread;
+pthread_mutex_t virtualMutex;
+pthread_cond_t virtualSignal;
+uint64_t virtualHits, virtualMisses, virtualUploads, virtualEvictions, virtualBytes;
+Handle pageHandle, atlasHandle, pageSampler, atlasSampler;
+Handle virtualStaging;
+uint8_t *virtualMapped;
+VkCommandPool virtualPool;
+VkCommandBuffer *virtualCommands;
+uint32_t feedbackWidth, feedbackHeight, feedbackStale;
+VkExtent2D *feedbackExtents;
+Handle *feedbackBuffers;
+uint32_t **feedbackData;
+PackedTexture packedTextures[ATLAS_ENTRIES];
+uint32_t packedCount, packedLayers, packedCached;
+uint8_t *packedPixels;
+Handle packedHandle, packedSampler;
+int residency;
+uint32_t residentCount;
+ResidentTexture residentTextures[RESIDENCY_TEXTURES];
+VkDeviceSize residencyBudget;
+uint64_t residencyLoads, residencyEvictions, residencyUploaded, residencyFrames, residencyResident, residencyDistance;
 
 void setup();
 void clean();
 void recreateSwapchain();
-void cleanupSwapchain();
-void recreatePipeline();
-void cleanupPipeline();
+void retireSwapchain();
+void releaseSwapchains(uint64_t completed);
+void updateRenderState();
+void generateMipmaps();
+Handle acquireHandle(HandleTable *table);
+uint32_t acquireSlot(HandleTable *table, Handle *handle);
+uint32_t lookupHandle(HandleTable *table, Handle handle);
+void destroyHandle(HandleTable *table, Handle handle);
+void removeMesh(Handle handle);
+void markPartition(uint32_t slot);
+void invalidatePartitions();
+void invalidateFrame(uint32_t frame);
+Handle insertGround();
+double measureTime();
 
 void printlog(int success, const char *format, ...)
 {
@@ -229,12 +671,28 @@ void keyEvent(GLFWwindow* window, int key, int scancode, int action, int mods)
 			else if(key == GLFW_KEY_C)
 			{
 				cullMode = !cullMode;
-				recreatePipeline();
+				updateRenderState();
 			}
 			else if(key == GLFW_KEY_V)
 			{
 				fillMode = !fillMode;
-				recreatePipeline();
+				updateRenderState();
+			}
+			else if(key == GLFW_KEY_Z)
+			{
+				depthMode = !depthMode;
+				updateRenderState();
+			}
+			else if(key == GLFW_KEY_G)
+			{
+				if(groundMesh != HANDLE_NULL)
+					removeMesh(groundMesh);
+				groundMesh = groundMesh == HANDLE_NULL ? insertGround() : HANDLE_NULL;
+			}
+			else if(key == GLFW_KEY_T)
+			{
+				residency = !residency;
+				printlog(1, "Texture Residency: %s", residency ? "Feedback" : "Disabled");
 			}
 			else if(key == GLFW_KEY_ESCAPE)
 			{
@@ -294,8 +752,8 @@ SwapchainDetails generateSwapchainDetails(VkPhysicalDevice temporaryDevice)
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(temporaryDevice, surface, &temporaryDetails.capabilities);
 	vkGetPhysicalDeviceSurfaceFormatsKHR(temporaryDevice, surface, &temporaryDetails.formatCount, NULL);
 	vkGetPhysicalDeviceSurfacePresentModesKHR(temporaryDevice, surface, &temporaryDetails.modeCount, NULL);
-	temporaryDetails.surfaceFormats = malloc(temporaryDetails.formatCount * sizeof(VkSurfaceFormatKHR));
-	temporaryDetails.presentModes = malloc(temporaryDetails.modeCount * sizeof(VkPresentModeKHR));
+	temporaryDetails.surfaceFormats = allocateHost(HOST_SWAPCHAIN, temporaryDetails.formatCount * sizeof(VkSurfaceFormatKHR));
+	temporaryDetails.presentModes = allocateHost(HOST_SWAPCHAIN, temporaryDetails.modeCount * sizeof(VkPresentModeKHR));
 	vkGetPhysicalDeviceSurfaceFormatsKHR(temporaryDevice, surface,
 	 &temporaryDetails.formatCount, temporaryDetails.surfaceFormats);
 	vkGetPhysicalDeviceSurfacePresentModesKHR(temporaryDevice, surface,
@@ -308,10 +766,10 @@ void pickPhysicalDevice()
 	uint32_t deviceCount;
 	int32_t maxScore = -1, bestIndex = -1;
 	VkSampleCountFlags bestSample = VK_SAMPLE_COUNT_1_BIT;
-	char *deviceName = malloc(VK_MAX_PHYSICAL_DEVICE_NAME_SIZE);
+	char *deviceName = allocateHost(HOST_DEVICE, VK_MAX_PHYSICAL_DEVICE_NAME_SIZE);
 
 	vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
-	VkPhysicalDevice *devices = malloc(deviceCount * sizeof(VkPhysicalDevice));
+	VkPhysicalDevice *devices = allocateHost(HOST_DEVICE, deviceCount * sizeof(VkPhysicalDevice));
 	vkEnumeratePhysicalDevices(instance, &deviceCount, devices);
 
 	for(uint32_t deviceIndex = 0; deviceIndex < deviceCount; deviceIndex++)
@@ -326,13 +784,25 @@ void pickPhysicalDevice()
 		vkGetPhysicalDeviceSurfacePresentModesKHR(devices[deviceIndex], surface, &modeCount, NULL);
 
 		vkEnumerateDeviceExtensionProperties(devices[deviceIndex], NULL, &extensionCount, NULL);
-		VkExtensionProperties *extensionProperties = malloc(extensionCount * sizeof(VkExtensionProperties));
+		VkExtensionProperties *extensionProperties = allocateHost(HOST_DEVICE, extensionCount * sizeof(VkExtensionProperties));
 		vkEnumerateDeviceExtensionProperties(devices[deviceIndex], NULL, &extensionCount, extensionProperties);
 		for(uint32_t extensionIndex = 0; extensionIndex < extensionCount; extensionIndex++)
 			if((swapchainSupport =
 			 !strcmp(extensionProperties[extensionIndex].extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME)))
 				break;
-		free(extensionProperties);
+		freeHost(extensionProperties);
+
+		// Frame pacing, uploads and the compute stage all run on timeline semaphores, which are core from 1.2
+		VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+		vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+		if(deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+		{
+			VkPhysicalDeviceFeatures2 features = {};
+			features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features.pNext = &vulkan12Features;
+			vkGetPhysicalDeviceFeatures2(devices[deviceIndex], &features);
+		}
 
 		VkSampleCountFlags sampleCount =
 		 deviceProperties.limits.framebufferColorSampleCounts < deviceProperties.limits.framebufferDepthSampleCounts ?
@@ -347,8 +817,8 @@ void pickPhysicalDevice()
 			}
 		}
 
-		if(formatCount && modeCount && swapchainSupport &&
-		 deviceFeatures.geometryShader && deviceFeatures.samplerAnisotropy)
+		if(formatCount && modeCount && swapchainSupport && vulkan12Features.timelineSemaphore &&
+		 deviceFeatures.geometryShader && deviceFeatures.samplerAnisotropy && deviceFeatures.fragmentStoresAndAtomics)
 		{
 			int32_t deviceScore = extensionCount + (formatCount + modeCount) * 16 + sampleCount;
 			if(deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
@@ -368,15 +838,15 @@ void pickPhysicalDevice()
 	physicalDevice = devices[bestIndex];
 	msaaSamples = bestSample;
 	swapchainDetails = generateSwapchainDetails(physicalDevice);
-	free(deviceName);
-	free(devices);
+	freeHost(deviceName);
+	freeHost(devices);
 }
 
 void createLogicalDevice()
 {
 	uint32_t queueCount;
 	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, NULL);
-	VkQueueFamilyProperties *queueProperties = malloc(queueCount * sizeof(VkQueueFamilyProperties));
+	VkQueueFamilyProperties *queueProperties = allocateHost(HOST_DEVICE, queueCount * sizeof(VkQueueFamilyProperties));
 	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queueProperties);
 
 	for(uint32_t queueIndex = 0; queueIndex < queueCount; queueIndex++)
@@ -390,38 +860,148 @@ void createLogicalDevice()
 			graphicsIndex = queueIndex;
 	}
 
-	float queuePriority = 1.0f;
-	queueCount = graphicsIndex == presentIndex ? 1 : 2;
-	VkDeviceQueueCreateInfo *queueList = malloc(queueCount * sizeof(VkDeviceQueueCreateInfo));
+	// Families with only the transfer bit map to the copy engines, which run alongside rendering
+	transferIndex = graphicsIndex;
+	for(uint32_t queueIndex = 0; queueIndex < queueCount; queueIndex++)
+		if(queueProperties[queueIndex].queueCount > 0 && !sharedQueues &&
+		 queueProperties[queueIndex].queueFlags & VK_QUEUE_TRANSFER_BIT &&
+		 !(queueProperties[queueIndex].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			transferIndex = queueIndex;
+
+	// Compute families without graphics are the asynchronous ones, they fill gaps left by the raster work
+	computeIndex = graphicsIndex;
+	for(uint32_t queueIndex = 0; queueIndex < queueCount; queueIndex++)
+		if(queueProperties[queueIndex].queueCount > 0 && !sharedQueues &&
+		 queueProperties[queueIndex].queueFlags & VK_QUEUE_COMPUTE_BIT &&
+		 !(queueProperties[queueIndex].queueFlags & VK_QUEUE_GRAPHICS_BIT))
+			computeIndex = queueIndex;
+	freeHost(queueProperties);
 
-	VkDeviceQueueCreateInfo graphicsInfo = {};
-	graphicsInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	graphicsInfo.queueCount = 1;
-	graphicsInfo.queueFamilyIndex = graphicsIndex;
-	graphicsInfo.pQueuePriorities = &queuePriority;
-	queueList[0] = graphicsInfo;
+	float queuePriority = 1.0f;
+	uint32_t families[] = {graphicsIndex, presentIndex, transferIndex, computeIndex};
+	VkDeviceQueueCreateInfo *queueList = allocateHost(HOST_DEVICE, 4 * sizeof(VkDeviceQueueCreateInfo));
+	queueCount = 0;
 
-	if(queueCount == 2)
+	for(uint32_t familyIndex = 0; familyIndex < 4; familyIndex++)
 	{
-		VkDeviceQueueCreateInfo presentInfo = {};
-		presentInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		presentInfo.queueCount = 1;
-		presentInfo.queueFamilyIndex = presentIndex;
-		presentInfo.pQueuePriorities = &queuePriority;
-		queueList[1] = presentInfo;
+		uint32_t duplicate = 0;
+		for(uint32_t queueIndex = 0; queueIndex < queueCount; queueIndex++)
+			duplicate |= queueList[queueIndex].queueFamilyIndex == families[familyIndex];
+		if(duplicate)
+			continue;
+
+		VkDeviceQueueCreateInfo queueInfo = {};
+		queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueInfo.queueCount = 1;
+		queueInfo.queueFamilyIndex = families[familyIndex];
+		queueInfo.pQueuePriorities = &queuePriority;
+		queueList[queueCount++] = queueInfo;
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	mipmapStorage = supportedFeatures.shaderStorageImageWriteWithoutFormat;
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.sampleRateShading = VK_TRUE;
 	deviceFeatures.fillModeNonSolid = VK_TRUE;
+	deviceFeatures.fragmentStoresAndAtomics = VK_TRUE;
+	deviceFeatures.shaderStorageImageWriteWithoutFormat = mipmapStorage;
+
+	uint32_t supportedCount;
+	vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &supportedCount, NULL);
+	VkExtensionProperties *supportedExtensions = allocateHost(HOST_DEVICE, supportedCount * sizeof(VkExtensionProperties));
+	vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &supportedCount, supportedExtensions);
+	uint32_t presentIdSupport = 0, presentWaitSupport = 0, dynamicSupport = 0;
+	for(uint32_t extensionIndex = 0; extensionIndex < supportedCount; extensionIndex++)
+	{
+		dynamicSupport |= !strcmp(supportedExtensions[extensionIndex].extensionName,
+		 VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+		memoryBudget |= !strcmp(supportedExtensions[extensionIndex].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		presentIdSupport |= !strcmp(supportedExtensions[extensionIndex].extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME);
+		presentWaitSupport |= !strcmp(supportedExtensions[extensionIndex].extensionName,
+		 VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+	}
+	freeHost(supportedExtensions);
 
-	
-	const char *extensionNames[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
-	uint32_t extensionCount = sizeof(extensionNames) / sizeof(extensionNames[0]);
+	// Present wait reports when a frame reached the display, which is what the latency pacing aims for
+	VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {};
+	presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {};
+	presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	presentIdFeatures.pNext = &presentWaitFeatures;
+
+	if(presentIdSupport && presentWaitSupport)
+	{
+		VkPhysicalDeviceFeatures2 features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &presentIdFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+		presentWait = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+	}
+
+	// Cull mode, front face and depth state are dynamic in core 1.3, polygon mode needs the third extension
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	dynamicState = deviceProperties.apiVersion >= VK_API_VERSION_1_3;
+
+	VkPhysicalDeviceExtendedDynamicState3FeaturesEXT polygonFeatures = {};
+	polygonFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+	if(dynamicState && dynamicSupport)
+	{
+		VkPhysicalDeviceFeatures2 features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &polygonFeatures;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+		dynamicPolygon = polygonFeatures.extendedDynamicState3PolygonMode;
+	}
+
+	// Dynamic rendering is core in 1.3 as well, the render pass path stays for older drivers and comparison
+	VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+	vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+	if(dynamicState && !renderPasses)
+	{
+		VkPhysicalDeviceFeatures2 features = {};
+		features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		features.pNext = &vulkan13Features;
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+		dynamicRendering = vulkan13Features.dynamicRendering;
+	}
+
+	const char *extensionNames[5] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	uint32_t extensionCount = 1;
+	if(memoryBudget)
+		extensionNames[extensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+	if(presentWait)
+	{
+		extensionNames[extensionCount++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+		extensionNames[extensionCount++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+	}
+	if(dynamicPolygon)
+		extensionNames[extensionCount++] = VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME;
+
+	// Only the polygon mode is enabled out of the third extended dynamic state
+	polygonFeatures = (VkPhysicalDeviceExtendedDynamicState3FeaturesEXT){};
+	polygonFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+	polygonFeatures.pNext = presentWait ? &presentIdFeatures : NULL;
+	polygonFeatures.extendedDynamicState3PolygonMode = VK_TRUE;
+
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.pNext = dynamicPolygon ? (void*)&polygonFeatures : presentWait ? (void*)&presentIdFeatures : NULL;
+	vulkan12Features.timelineSemaphore = VK_TRUE;
+
+	vulkan13Features = (VkPhysicalDeviceVulkan13Features){};
+	vulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	vulkan13Features.pNext = &vulkan12Features;
+	vulkan13Features.dynamicRendering = VK_TRUE;
 
 	VkDeviceCreateInfo deviceInfo = {};
 	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceInfo.pNext = dynamicRendering ? (void*)&vulkan13Features : (void*)&vulkan12Features;
 	deviceInfo.enabledExtensionCount = extensionCount;
 	deviceInfo.ppEnabledExtensionNames = extensionNames;
 	deviceInfo.pEnabledFeatures = &deviceFeatures;
@@ -429,10 +1009,18 @@ void createLogicalDevice()
 	deviceInfo.pQueueCreateInfos = queueList;
 
 	printlog(vkCreateDevice(physicalDevice, &deviceInfo, NULL, &device) == VK_SUCCESS,
-	 "Create Logical Device: %s Queues", queueCount == 1 ? "Common" : "Specialized");
+	 "Create Logical Device: %s Queues, %s Transfer Queue, %s Compute Queue%s", queueCount == 1 ? "Common" :
+	 "Specialized", transferIndex == graphicsIndex ? "Shared" : "Dedicated",
+	 computeIndex == graphicsIndex ? "Shared" : "Async", presentWait ? ", Present Wait" : "");
+	if(presentWait)
+		waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+	if(dynamicPolygon)
+		setPolygonMode = (PFN_vkCmdSetPolygonModeEXT)vkGetDeviceProcAddr(device, "vkCmdSetPolygonModeEXT");
 	vkGetDeviceQueue(device, graphicsIndex, 0, &graphicsQueue);
 	vkGetDeviceQueue(device, presentIndex, 0, &presentQueue);
-	free(queueList);
+	vkGetDeviceQueue(device, transferIndex, 0, &transferQueue);
+	vkGetDeviceQueue(device, computeIndex, 0, &computeQueue);
+	freeHost(queueList);
 }
 
 VkFormat chooseSupportedFormat(VkFormat *candidates, uint32_t candidateCount,
@@ -482,16 +1070,21 @@ VkSurfaceFormatKHR chooseSurfaceFormat(VkSurfaceFormatKHR *surfaceFormats, uint3
 
 VkPresentModeKHR choosePresentationMode(VkPresentModeKHR *presentModes, uint32_t modeCount)
 {
-	int8_t mailbox = 0;
+	// The requested mode is taken when supported, then mailbox and immediate, and FIFO is always there
+	VkPresentModeKHR preferences[] = {presentRequest, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
 
-	for(uint32_t modeIndex = 0; modeIndex < modeCount; modeIndex++)
-		if(presentModes[modeIndex] == VK_PRESENT_MODE_MAILBOX_KHR)
-			mailbox = 1;
+	for(uint32_t preference = 0; preference < 3; preference++)
+		for(uint32_t modeIndex = 0; modeIndex < modeCount; modeIndex++)
+			if(presentModes[modeIndex] == preferences[preference])
+				return preferences[preference];
 
-	if(mailbox)
-		return VK_PRESENT_MODE_MAILBOX_KHR;
-	else
-		return VK_PRESENT_MODE_IMMEDIATE_KHR;
+	return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+const char *presentModeName(VkPresentModeKHR presentMode)
+{
+	return presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? "Mailbox" : presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR ?
+	 "Immediate" : presentMode == VK_PRESENT_MODE_FIFO_RELAXED_KHR ? "FIFO Relaxed" : "FIFO";
 }
 
 VkImageView createImageView(VkImage image, uint32_t levels, VkFormat format, VkImageAspectFlags flags)
@@ -522,8 +1115,11 @@ void createSwapchain()
 	 swapchainDetails.surfaceFormats, swapchainDetails.formatCount);
 	VkPresentModeKHR presentMode = choosePresentationMode(
 	 swapchainDetails.presentModes, swapchainDetails.modeCount);
-	framebufferSize = swapchainDetails.capabilities.minImageCount +
-	 (swapchainDetails.capabilities.minImageCount < swapchainDetails.capabilities.maxImageCount);
+	// One image more than the frames in flight, so acquiring never waits on a frame the CPU could still overlap
+	framebufferSize = swapchainDetails.capabilities.minImageCount + 1 > framebufferLimit + 1 ?
+	 swapchainDetails.capabilities.minImageCount + 1 : framebufferLimit + 1;
+	if(swapchainDetails.capabilities.maxImageCount && framebufferSize > swapchainDetails.capabilities.maxImageCount)
+		framebufferSize = swapchainDetails.capabilities.maxImageCount;
 	swapchainFormat = surfaceFormat.format;
 	swapchainExtent.width = width;
 	swapchainExtent.height = height;
@@ -531,7 +1127,8 @@ void createSwapchain()
 	VkSwapchainCreateInfoKHR swapchainInfo = {};
 	swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swapchainInfo.surface = surface;
-	swapchainInfo.oldSwapchain = VK_NULL_HANDLE;
+	// Handing over the retiring swapchain lets the presentation engine reuse its resources
+	swapchainInfo.oldSwapchain = swapchain;
 	swapchainInfo.minImageCount = framebufferSize;
 	swapchainInfo.imageFormat = swapchainFormat;
 	swapchainInfo.imageColorSpace = surfaceFormat.colorSpace;
@@ -552,14 +1149,14 @@ void createSwapchain()
 	}
 
 	printlog(vkCreateSwapchainKHR(device, &swapchainInfo, NULL, &swapchain) == VK_SUCCESS,
-	 "Create Swapchain: %s mode with %d images",
-	 presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? "Mailbox" : "Immediate", framebufferSize);
+	 "Create Swapchain: %s mode with %d images", presentModeName(presentMode), framebufferSize);
 	vkGetSwapchainImagesKHR(device, swapchain, &framebufferSize, NULL);
-	swapchainImages = malloc(framebufferSize * sizeof(VkImage));
+	swapchainImages = allocateHost(HOST_SWAPCHAIN, framebufferSize * sizeof(VkImage));
 	vkGetSwapchainImagesKHR(device, swapchain, &framebufferSize, swapchainImages);
 	printlog(framebufferSize && swapchainImages, "Acquire Swapchain Images");
+	imageValues = allocateHostZeroed(HOST_SWAPCHAIN, framebufferSize, sizeof(uint64_t));
 
-	swapchainViews = malloc(framebufferSize * sizeof(VkImageView));
+	swapchainViews = allocateHost(HOST_SWAPCHAIN, framebufferSize * sizeof(VkImageView));
 	for(uint32_t viewIndex = 0; viewIndex < framebufferSize; viewIndex++)
 		swapchainViews[viewIndex] =
 		 createImageView(swapchainImages[viewIndex], 1, swapchainFormat, VK_IMAGE_ASPECT_COLOR_BIT);
@@ -568,6 +1165,15 @@ void createSwapchain()
 
 void createRenderPass()
 {
+	depthAttachmentFormat = chooseDepthFormat();
+
+	// Dynamic rendering names its attachments while recording, so there is no render pass to build
+	if(dynamicRendering)
+	{
+		printlog(1, "Create Render Pass: Dynamic Rendering");
+		return;
+	}
+
 	VkAttachmentReference colorAttachmentReference = {};
 	colorAttachmentReference.attachment = 0;
 	colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -591,7 +1197,7 @@ void createRenderPass()
 	colorAttachment.format = swapchainFormat;
 	colorAttachment.samples = msaaSamples;
 	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -641,8 +1247,8 @@ void createRenderPass()
 void createDescriptorSetLayout()
 {
 	VkDescriptorSetLayoutBinding uniformBufferBinding = {};
-	uniformBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uniformBufferBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	uniformBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uniformBufferBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 	uniformBufferBinding.descriptorCount = 1;
 	uniformBufferBinding.binding = 0;
 
@@ -652,10 +1258,41 @@ void createDescriptorSetLayout()
 	samplerLayoutBinding.descriptorCount = 1;
 	samplerLayoutBinding.binding = 1;
 
+	VkDescriptorSetLayoutBinding pageLayoutBinding = {};
+	pageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pageLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	pageLayoutBinding.descriptorCount = 1;
+	pageLayoutBinding.binding = 2;
+
+	VkDescriptorSetLayoutBinding atlasLayoutBinding = {};
+	atlasLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	atlasLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	atlasLayoutBinding.descriptorCount = 1;
+	atlasLayoutBinding.binding = 3;
+
+	VkDescriptorSetLayoutBinding feedbackLayoutBinding = {};
+	feedbackLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	feedbackLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	feedbackLayoutBinding.descriptorCount = 1;
+	feedbackLayoutBinding.binding = 4;
+
+	VkDescriptorSetLayoutBinding packedLayoutBinding = {};
+	packedLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	packedLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	packedLayoutBinding.descriptorCount = 1;
+	packedLayoutBinding.binding = 5;
+
+	VkDescriptorSetLayoutBinding objectLayoutBinding = {};
+	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	objectLayoutBinding.descriptorCount = 1;
+	objectLayoutBinding.binding = 6;
+
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = 2;
-	layoutInfo.pBindings = (VkDescriptorSetLayoutBinding[]){uniformBufferBinding, samplerLayoutBinding};
+	layoutInfo.bindingCount = 7;
+	layoutInfo.pBindings = (VkDescriptorSetLayoutBinding[]){uniformBufferBinding, samplerLayoutBinding,
+	 pageLayoutBinding, atlasLayoutBinding, feedbackLayoutBinding, packedLayoutBinding, objectLayoutBinding};
 
 	printlog(vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &descriptorSetLayout) == VK_SUCCESS,
 	 "Create Descriptor Set Layout: Binding Count = %d", layoutInfo.bindingCount);
@@ -668,7 +1305,7 @@ VkShaderModule initializeShaderModule(const char *shaderName, const char *filePa
 	size_t size = ftell(file);
 	rewind(file);
 
-	uint32_t *shaderData = calloc(size, 1);
+	uint32_t *shaderData = allocateHostZeroed(HOST_PIPELINE, size, 1);
 	printlog(fread(shaderData, 1, size, file) == size, NULL);
 	fclose(file);
 
@@ -680,7 +1317,7 @@ VkShaderModule initializeShaderModule(const char *shaderName, const char *filePa
 	VkShaderModule shaderModule;
 	printlog(vkCreateShaderModule(device, &shaderInfo, NULL, &shaderModule) == VK_SUCCESS,
 	 "Create %s Shader Module: %zd bytes", shaderName, size);
-	free(shaderData);
+	freeHost(shaderData);
 
 	return shaderModule;
 }
@@ -730,7 +1367,78 @@ void createShaderModules()
 	fragmentShader = initializeShaderModule("Fragment", "shaders/frag.spv");
 }
 
-void createGraphicsPipeline()
+void createPipelineCache()
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	snprintf(pipelineCachePath, sizeof(pipelineCachePath), PIPELINE_CACHE, deviceProperties.vendorID,
+	 deviceProperties.deviceID);
+
+	void *data = NULL;
+	size_t size = 0;
+	FILE *file = fopen(pipelineCachePath, "rb");
+	if(file)
+	{
+		fseek(file, 0, SEEK_END);
+		long length = ftell(file);
+		fseek(file, 0, SEEK_SET);
+
+		if(length > 0)
+		{
+			data = allocateHost(HOST_PIPELINE, length);
+			size = fread(data, 1, length, file) == (size_t)length ? (size_t)length : 0;
+		}
+		fclose(file);
+	}
+
+	// Drivers reject foreign data themselves, but a cache left by another driver version is dropped up front
+	uint32_t header[4] = {};
+	if(size >= sizeof(header) + VK_UUID_SIZE)
+		memcpy(header, data, sizeof(header));
+	if(header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header[2] != deviceProperties.vendorID ||
+	 header[3] != deviceProperties.deviceID ||
+	 memcmp((uint8_t*)data + sizeof(header), deviceProperties.pipelineCacheUUID, VK_UUID_SIZE))
+		size = 0;
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = size;
+	cacheInfo.pInitialData = size ? data : NULL;
+
+	printlog(vkCreatePipelineCache(device, &cacheInfo, NULL, &pipelineCache) == VK_SUCCESS,
+	 "Create Pipeline Cache: %s, %lu bytes", size ? "Warm" : "Cold", size);
+	pipelineCacheLoaded = size;
+	freeHost(data);
+}
+
+void storePipelineCache()
+{
+	size_t size = 0;
+	vkGetPipelineCacheData(device, pipelineCache, &size, NULL);
+	void *data = allocateHost(HOST_PIPELINE, size ? size : 1);
+	vkGetPipelineCacheData(device, pipelineCache, &size, data);
+
+	// Written beside the old file and renamed over it, so an interrupted write never leaves a torn cache
+	char temporary[72];
+	snprintf(temporary, sizeof(temporary), "%s.tmp", pipelineCachePath);
+	FILE *file = fopen(temporary, "wb");
+	if(file)
+	{
+		int written = fwrite(data, 1, size, file) == size;
+		if(fclose(file) || !written || rename(temporary, pipelineCachePath))
+			remove(temporary);
+	}
+
+	freeHost(data);
+}
+
+uint32_t pipelineVariant(uint32_t cull, uint32_t fill, uint32_t depth)
+{
+	// State that can be set while recording is left out of the variant, so those toggles share one pipeline
+	return (dynamicState ? 0 : cull) | (dynamicPolygon ? 0 : fill << 1) | (dynamicState ? 0 : depth << 2);
+}
+
+VkPipeline buildGraphicsPipeline(uint32_t variant, VkPipelineLayout *layout)
 {
 	VkPipelineShaderStageCreateInfo vertexStageInfo = {};
 	vertexStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -758,25 +1466,11 @@ void createGraphicsPipeline()
 	inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)swapchainExtent.width;
-	viewport.height = (float)swapchainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkOffset2D offset = {};
-	VkRect2D scissor = {};
-	scissor.offset = offset;
-	scissor.extent = swapchainExtent;
-
+	// Viewport and scissor are set while recording, so pipelines outlive window resizes
 	VkPipelineViewportStateCreateInfo viewportStateInfo = {};
 	viewportStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportStateInfo.viewportCount = 1;
-	viewportStateInfo.pViewports = &viewport;
 	viewportStateInfo.scissorCount = 1;
-	viewportStateInfo.pScissors = &scissor;
 
 	VkPipelineRasterizationStateCreateInfo rasterizerInfo = {};
 	rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -785,8 +1479,8 @@ void createGraphicsPipeline()
 	rasterizerInfo.depthClampEnable = VK_FALSE;
 	rasterizerInfo.rasterizerDiscardEnable = VK_FALSE;
 	rasterizerInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	rasterizerInfo.polygonMode = fillMode ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
-	rasterizerInfo.cullMode = cullMode ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+	rasterizerInfo.polygonMode = variant & 2 ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL;
+	rasterizerInfo.cullMode = variant & 1 ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
 
 	VkPipelineMultisampleStateCreateInfo multisamplingInfo = {};
 	multisamplingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
@@ -814,22 +1508,45 @@ void createGraphicsPipeline()
 
 	VkPipelineDepthStencilStateCreateInfo depthStencilInfo = {};
 	depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depthStencilInfo.depthTestEnable = VK_TRUE;
-	depthStencilInfo.depthWriteEnable = VK_TRUE;
+	depthStencilInfo.depthTestEnable = variant & 4 ? VK_FALSE : VK_TRUE;
+	depthStencilInfo.depthWriteEnable = variant & 4 ? VK_FALSE : VK_TRUE;
 	depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
 	depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
 	depthStencilInfo.stencilTestEnable = VK_FALSE;
 
+	VkDynamicState dynamicStates[7] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	uint32_t dynamicCount = 2;
+	if(dynamicState)
+	{
+		dynamicStates[dynamicCount++] = VK_DYNAMIC_STATE_CULL_MODE;
+		dynamicStates[dynamicCount++] = VK_DYNAMIC_STATE_FRONT_FACE;
+		dynamicStates[dynamicCount++] = VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE;
+		dynamicStates[dynamicCount++] = VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE;
+	}
+	if(dynamicPolygon)
+		dynamicStates[dynamicCount++] = VK_DYNAMIC_STATE_POLYGON_MODE_EXT;
+
+	VkPipelineDynamicStateCreateInfo dynamicInfo = {};
+	dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicInfo.dynamicStateCount = dynamicCount;
+	dynamicInfo.pDynamicStates = dynamicStates;
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
 
-	printlog(vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayout) == VK_SUCCESS,
-	 "Create Pipeline Layout: Set Layout Count = %d", pipelineLayoutInfo.setLayoutCount);
+	printlog(vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, layout) == VK_SUCCESS, NULL);
+
+	VkPipelineRenderingCreateInfo renderingInfo = {};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &swapchainFormat;
+	renderingInfo.depthAttachmentFormat = depthAttachmentFormat;
 
 	VkGraphicsPipelineCreateInfo pipelineInfo = {};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = dynamicRendering ? &renderingInfo : NULL;
 	pipelineInfo.renderPass = renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
@@ -842,20 +1559,88 @@ void createGraphicsPipeline()
 	pipelineInfo.pMultisampleState = &multisamplingInfo;
 	pipelineInfo.pColorBlendState = &colorBlendInfo;
 	pipelineInfo.pDepthStencilState = &depthStencilInfo;
-	pipelineInfo.layout = pipelineLayout;
+	pipelineInfo.pDynamicState = &dynamicInfo;
+	pipelineInfo.layout = *layout;
 
-	printlog(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &graphicsPipeline)
-	 == VK_SUCCESS, "Create Graphics Pipeline: %u x %u", width, height);
+	VkPipeline pipeline;
+	printlog(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL, &pipeline) == VK_SUCCESS, NULL);
+	return pipeline;
 }
 
-void createCommandPool()
+void *buildPipelineVariants(void *argument)
 {
-	VkCommandPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = graphicsIndex;
+	(void)argument;
+	double start = measureTime();
+
+	// Only Vulkan objects are made here, the handle table is left to the main thread
+	for(uint32_t variant = 0; variant < PIPELINE_VARIANTS; variant++)
+		if(variant != pipelineCurrent && pipelineVariants[variant] != HANDLE_NULL)
+			builtPipelines[variant] = buildGraphicsPipeline(variant, &builtLayouts[variant]);
+
+	builderTime = measureTime() - start;
+	return NULL;
+}
+
+void createGraphicsPipeline()
+{
+	pipelineStart = measureTime();
+	pipelineCurrent = pipelineVariant(cullMode, fillMode, depthMode);
+
+	uint32_t variantCount = 0;
+	for(uint32_t variant = 0; variant < PIPELINE_VARIANTS; variant++)
+	{
+		pipelineVariants[variant] = HANDLE_NULL;
+		if(variant == pipelineVariant(variant & 1, variant >> 1 & 1, variant >> 2 & 1))
+		{
+			pipelineVariants[variant] = acquireHandle(&pipelineTable);
+			variantCount++;
+		}
+	}
+
+	// The variant in use is built right away and the rest follow on a thread while setup carries on
+	uint32_t slot = lookupHandle(&pipelineTable, pipelineVariants[pipelineCurrent]);
+	pipelineObjects[slot] = buildGraphicsPipeline(pipelineCurrent, &pipelineLayouts[slot]);
+	graphicsPipeline = pipelineVariants[pipelineCurrent];
+	pipelineTime += measureTime() - pipelineStart;
+
+	pipelinesPending = variantCount > 1;
+	if(pipelinesPending)
+		pthread_create(&pipelineBuilder, NULL, buildPipelineVariants, NULL);
+
+	printlog(1, "Create Graphics Pipeline: %u Variants, %s%s", variantCount,
+	 dynamicState ? "Dynamic Cull and Depth" : "Static State", dynamicPolygon ? ", Dynamic Polygon Mode" : "");
+}
+
+void finishGraphicsPipelines()
+{
+	if(!pipelinesPending)
+		return;
+
+	pthread_join(pipelineBuilder, NULL);
+	pipelinesPending = 0;
+	pipelineTime += builderTime;
+
+	for(uint32_t variant = 0; variant < PIPELINE_VARIANTS; variant++)
+	{
+		if(variant == pipelineCurrent || pipelineVariants[variant] == HANDLE_NULL)
+			continue;
+
+		uint32_t slot = lookupHandle(&pipelineTable, pipelineVariants[variant]);
+		pipelineObjects[slot] = builtPipelines[variant];
+		pipelineLayouts[slot] = builtLayouts[variant];
+	}
 
-	printlog(vkCreateCommandPool(device, &poolInfo, NULL, &commandPool) == VK_SUCCESS,
-	 "Create Command Pool: Queue Index = %u", graphicsIndex);
+	// New variants are saved right away, so a crash later on still leaves the next start warm
+	storePipelineCache();
+	printlog(1, "Finish Pipeline Variants: %.3f ms", 1000.0 * (measureTime() - pipelineStart));
+}
+
+void cleanupGraphicsPipelines()
+{
+	finishGraphicsPipelines();
+	for(uint32_t variant = 0; variant < PIPELINE_VARIANTS; variant++)
+		if(pipelineVariants[variant] != HANDLE_NULL)
+			destroyHandle(&pipelineTable, pipelineVariants[variant]);
 }
 
 uint32_t chooseMemoryType(uint32_t filter, VkMemoryPropertyFlags flags)
@@ -870,710 +1655,4599 @@ uint32_t chooseMemoryType(uint32_t filter, VkMemoryPropertyFlags flags)
 	return 0;
 }
 
-void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
- VkMemoryPropertyFlags properties, VkBuffer *buffer, VkDeviceMemory *bufferMemory)
+void createMemory()
 {
-	VkBufferCreateInfo bufferInfo = {};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	bufferInfo.usage = usage;
-	bufferInfo.size = size;
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
 
-	printlog(vkCreateBuffer(device, &bufferInfo, NULL, buffer) == VK_SUCCESS, NULL);
+	// Buddy nodes are aligned to their own size, so linear and optimal resources only need separate
+	// blocks when the granularity is coarser than the smallest node
+	memorySeparate = deviceProperties.limits.bufferImageGranularity > MEMORY_MINIMUM;
+
+	// Unified memory and resizable BAR map the whole device local heap, while the classic 256 MB window
+	// is too small to hold geometry pools and is left to the driver
+	VkDeviceSize largest = 0;
+	for(uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+		if(memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT &&
+		 memoryProperties.memoryHeaps[heap].size > largest)
+			largest = memoryProperties.memoryHeaps[heap].size;
+
+	for(uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
+		memoryDirect |= !staging && (memoryProperties.memoryTypes[type].propertyFlags & MEMORY_DIRECT) == MEMORY_DIRECT &&
+		 memoryProperties.memoryHeaps[memoryProperties.memoryTypes[type].heapIndex].size == largest;
+
+	printlog(1, "Create Memory: %.3f MB Blocks, Granularity = %lu bytes, %s, %s, %s", MEMORY_BLOCK / 1048576.0,
+	 deviceProperties.limits.bufferImageGranularity, memorySeparate ? "Separate Linear Blocks" : "Shared Blocks",
+	 memoryBudget ? "Budget Extension" : "Estimated Budget", memoryDirect ? "Direct Uploads" : "Staged Uploads");
+}
 
-	VkMemoryRequirements memoryRequirements;
-	vkGetBufferMemoryRequirements(device, *buffer, &memoryRequirements);
+uint32_t createMemoryBlock(uint32_t type, uint32_t linear, VkDeviceSize size, uint32_t dedicated)
+{
+	uint32_t index = 0;
+	while(index < memoryBlockCount && memoryBlocks[index].memory != VK_NULL_HANDLE)
+		index++;
+	if(index == memoryBlockCount)
+		memoryBlocks = reallocateHost(HOST_DEVICE, memoryBlocks, ++memoryBlockCount * sizeof(MemoryBlock));
+
+	MemoryBlock *block = &memoryBlocks[index];
+	*block = (MemoryBlock){VK_NULL_HANDLE, size, 0, type, linear, 0, NULL, NULL};
 
 	VkMemoryAllocateInfo allocateInfo = {};
 	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memoryRequirements.size;
-	allocateInfo.memoryTypeIndex = chooseMemoryType(memoryRequirements.memoryTypeBits, properties);
+	allocateInfo.allocationSize = size;
+	allocateInfo.memoryTypeIndex = type;
+
+	printlog(vkAllocateMemory(device, &allocateInfo, NULL, &block->memory) == VK_SUCCESS,
+	 "Allocate Memory Block: Type %u, %.3f MB%s", type, size / 1048576.0, dedicated ? ", Dedicated" : "");
+
+	if(memoryProperties.memoryTypes[type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		vkMapMemory(device, block->memory, 0, size, 0, (void**)&block->mapped);
+
+	// Dedicated blocks hold exactly one allocation and have no tree, so they are never searched or kept as spares
+	if(!dedicated)
+	{
+		block->tree = allocateHost(HOST_DEVICE, (1 << MEMORY_ORDERS) - 1);
+		for(uint32_t depth = 0; depth < MEMORY_ORDERS; depth++)
+			memset(block->tree + (1 << depth) - 1, MEMORY_ORDERS - depth, 1 << depth);
+	}
 
-	printlog(vkAllocateMemory(device, &allocateInfo, NULL, bufferMemory) == VK_SUCCESS, NULL);
-	vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+	memoryHeapEngine[memoryProperties.memoryTypes[type].heapIndex] += size;
+	memoryDevice++;
+	memoryPeak = ++memoryLive > memoryPeak ? memoryLive : memoryPeak;
+	return index;
 }
 
-VkCommandBuffer beginSingleTimeCommand()
+void destroyMemoryBlock(MemoryBlock *block)
 {
-	VkCommandBufferAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocateInfo.commandPool = commandPool;
-	allocateInfo.commandBufferCount = 1;
+	if(block->mapped)
+		vkUnmapMemory(device, block->memory);
+	vkFreeMemory(device, block->memory, NULL);
+	freeHost(block->tree);
+
+	memoryHeapEngine[memoryProperties.memoryTypes[block->type].heapIndex] -= block->size;
+	block->memory = VK_NULL_HANDLE;
+	memoryLive--;
+}
 
-	VkCommandBuffer commandBuffer;
-	printlog(vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer) == VK_SUCCESS, NULL);
+int64_t allocateMemoryNode(MemoryBlock *block, uint32_t order)
+{
+	if(block->tree[0] <= order)
+		return -1;
 
-	VkCommandBufferBeginInfo beginInfo = {};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	uint32_t node = 0;
+	for(uint32_t current = MEMORY_ORDERS - 1; current > order; current--)
+	{
+		uint32_t left = 2 * node + 1, right = left + 1;
+		node = block->tree[left] > order && (block->tree[right] <= order ||
+		 block->tree[left] <= block->tree[right]) ? left : right;
+	}
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-	return commandBuffer;
+	block->tree[node] = 0;
+	int64_t offset = (int64_t)(node + 1 - (1 << (MEMORY_ORDERS - 1 - order))) * ((int64_t)MEMORY_MINIMUM << order);
+
+	while(node)
+	{
+		node = (node - 1) / 2;
+		block->tree[node] = block->tree[2 * node + 1] > block->tree[2 * node + 2] ?
+		 block->tree[2 * node + 1] : block->tree[2 * node + 2];
+	}
+
+	return offset;
 }
 
-void endSingleTimeCommand(VkCommandBuffer commandBuffer)
+void freeMemoryNode(MemoryBlock *block, VkDeviceSize offset, uint32_t order)
 {
-	vkEndCommandBuffer(commandBuffer);
+	uint32_t node = (1 << (MEMORY_ORDERS - 1 - order)) - 1 + offset / ((VkDeviceSize)MEMORY_MINIMUM << order);
+	block->tree[node] = order + 1;
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	while(node)
+	{
+		node = (node - 1) / 2;
+		order++;
 
-	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue);
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		uint8_t left = block->tree[2 * node + 1], right = block->tree[2 * node + 2];
+		block->tree[node] = left == order && right == order ? order + 1 : left > right ? left : right;
+	}
 }
 
-void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void allocateMemory(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, uint32_t linear,
+ uint32_t category, Allocation *allocation)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommand();
+	uint32_t type = chooseMemoryType(requirements.memoryTypeBits, properties), order = 0, index = 0;
+	VkDeviceSize size = requirements.size > requirements.alignment ? requirements.size : requirements.alignment;
+	int64_t offset = -1;
 
-	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset = 0;
-	copyRegion.dstOffset = 0;
-	copyRegion.size = size;
+	linear = memorySeparate && linear;
+	while(((VkDeviceSize)MEMORY_MINIMUM << order) < size)
+		order++;
+
+	// Lazily allocated memory is only committed as tiles touch it, so it never shares a block
+	if(((VkDeviceSize)MEMORY_MINIMUM << order) > MEMORY_BLOCK ||
+	 properties & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+	{
+		index = createMemoryBlock(type, linear, requirements.size, 1);
+		offset = 0;
+	}
+
+	for(; offset < 0 && index < memoryBlockCount; index++)
+		if(memoryBlocks[index].memory != VK_NULL_HANDLE && memoryBlocks[index].tree &&
+		 (memoryTarget == UINT32_MAX || index == memoryTarget) &&
+		 memoryBlocks[index].type == type && memoryBlocks[index].linear == linear &&
+		 (offset = allocateMemoryNode(&memoryBlocks[index], order)) >= 0)
+			break;
+
+	// Allocations pinned to a block fail rather than grow the pool, which would defeat the point of pinning them
+	if(offset < 0 && memoryTarget != UINT32_MAX)
+	{
+		*allocation = (Allocation){};
+		return;
+	}
+
+	if(offset < 0)
+	{
+		index = createMemoryBlock(type, linear, MEMORY_BLOCK, 0);
+		offset = allocateMemoryNode(&memoryBlocks[index], order);
+	}
 
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-	endSingleTimeCommand(commandBuffer);
+	// Blocks count the whole node they hand out, so the round-up slack is never mistaken for free space, while the
+	// categories count what was asked for
+	MemoryBlock *block = &memoryBlocks[index];
+	block->used += block->tree ? (VkDeviceSize)MEMORY_MINIMUM << order : requirements.size;
+	block->count++;
+	memoryCount++;
+	memoryRequests++;
+	memoryCategories[category] += requirements.size;
+	if(memoryCategories[category] > memoryCategoryPeak[category])
+		memoryCategoryPeak[category] = memoryCategories[category];
+
+	*allocation = (Allocation){block->memory, offset, requirements.size, index, order, category,
+	 block->mapped ? block->mapped + offset : NULL};
 }
 
-void createImage(uint32_t imageWidth, uint32_t imageHeight, uint32_t levels, VkSampleCountFlagBits samples,
- VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
- VkImage *image, VkDeviceMemory *memory)
+void freeMemory(Allocation *allocation)
 {
-	VkImageCreateInfo imageInfo = {};
-	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	imageInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	imageInfo.samples = samples;
-	imageInfo.format = format;
-	imageInfo.tiling = tiling;
-	imageInfo.usage = usage;
-	imageInfo.extent.width = imageWidth;
-	imageInfo.extent.height = imageHeight;
-	imageInfo.mipLevels = levels;
-	imageInfo.arrayLayers = 1;
-	imageInfo.extent.depth = 1;
+	MemoryBlock *block = &memoryBlocks[allocation->block];
+	block->used -= block->tree ? (VkDeviceSize)MEMORY_MINIMUM << allocation->order : allocation->size;
+	block->count--;
+	memoryCount--;
+	memoryCategories[allocation->category] -= allocation->size;
+
+	if(block->tree)
+		freeMemoryNode(block, allocation->offset, allocation->order);
+
+	// Keep one empty block per memory type around so staging buffers do not thrash vkAllocateMemory
+	int spare = !block->tree;
+	for(uint32_t index = 0; !block->count && !spare && index < memoryBlockCount; index++)
+		spare = &memoryBlocks[index] != block && memoryBlocks[index].memory != VK_NULL_HANDLE &&
+		 memoryBlocks[index].tree && !memoryBlocks[index].count &&
+		 memoryBlocks[index].type == block->type && memoryBlocks[index].linear == block->linear;
+
+	if(!block->count && spare)
+		destroyMemoryBlock(block);
+
+	*allocation = (Allocation){};
+}
 
-	printlog(vkCreateImage(device, &imageInfo, NULL, image) == VK_SUCCESS,
-	 "Create Image: %u x %u", imageWidth, imageHeight);
+void registerMemoryCallback(MemoryCallback callback)
+{
+	printlog(memoryCallbackCount < MEMORY_CALLBACKS, NULL);
+	memoryCallbacks[memoryCallbackCount++] = callback;
+}
 
-	VkMemoryRequirements memoryRequirements;
-	vkGetImageMemoryRequirements(device, *image, &memoryRequirements);
+void queryMemoryBudget()
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+	budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
 
-	VkMemoryAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocateInfo.allocationSize = memoryRequirements.size;
-	allocateInfo.memoryTypeIndex = chooseMemoryType(memoryRequirements.memoryTypeBits, properties);
+	VkPhysicalDeviceMemoryProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	properties.pNext = memoryBudget ? &budgetProperties : NULL;
+	vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties);
 
-	printlog(vkAllocateMemory(device, &allocateInfo, NULL, memory) == VK_SUCCESS,
-	 "Allocate Image Memory: Size = %lu bytes", memoryRequirements.size);
-	vkBindImageMemory(device, *image, *memory, 0);
+	// Without the extension only our own blocks are visible, so leave a fifth of each heap to everyone else
+	for(uint32_t heap = 0; heap < properties.memoryProperties.memoryHeapCount; heap++)
+	{
+		memoryHeapUsage[heap] = memoryBudget ? budgetProperties.heapUsage[heap] : memoryHeapEngine[heap];
+		memoryHeapBudget[heap] = memoryBudget ? budgetProperties.heapBudget[heap] :
+		 properties.memoryProperties.memoryHeaps[heap].size / 5 * 4;
+	}
 }
 
-void transitionImageLayout(VkImage image, uint32_t levels, VkFormat format, VkImageLayout layout)
+void reportMemoryBudget()
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommand();
+	for(uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+		printlog(1, "Memory Heap %u: %.3f MB Used of %.3f MB Budget, %.3f MB Engine%s", heap,
+		 memoryHeapUsage[heap] / 1048576.0, memoryHeapBudget[heap] / 1048576.0, memoryHeapEngine[heap] / 1048576.0,
+		 memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? ", Device Local" : "");
+
+	char categories[256] = {};
+	for(uint32_t category = 0; category < MEMORY_CATEGORIES; category++)
+		snprintf(categories + strlen(categories), sizeof(categories) - strlen(categories), "%s%s %.3f MB (%.3f MB Peak)",
+		 category ? ", " : "", memoryNames[category], memoryCategories[category] / 1048576.0,
+		 memoryCategoryPeak[category] / 1048576.0);
+	printlog(1, "Memory Categories: %s", categories);
+}
 
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.image = image;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	barrier.newLayout = layout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.levelCount = levels;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
- 	barrier.srcAccessMask = 0;
+void updateMemoryBudget()
+{
+	queryMemoryBudget();
 
-	VkPipelineStageFlags stage = 0;
+	for(uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+		if(memoryHeapUsage[heap] > memoryHeapBudget[heap] * MEMORY_PRESSURE)
+			for(uint32_t callback = 0; callback < memoryCallbackCount; callback++)
+				memoryCallbacks[callback](heap, memoryHeapUsage[heap], memoryHeapBudget[heap]);
 
-	if(layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+	if(memoryReport)
+		reportMemoryBudget();
+}
+
+double memoryFragmentation()
+{
+	VkDeviceSize available = 0, largest = 0;
+
+	for(uint32_t index = 0; index < memoryBlockCount; index++)
 	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		MemoryBlock *block = &memoryBlocks[index];
+		if(block->memory == VK_NULL_HANDLE || !block->tree)
+			continue;
+
+		VkDeviceSize node = block->tree[0] ? (VkDeviceSize)MEMORY_MINIMUM << (block->tree[0] - 1) : 0;
+		available += block->size - block->used;
+		largest = node > largest ? node : largest;
 	}
 
-	else if(layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+	return available ? 1.0 - (double)largest / available : 0.0;
+}
+
+void reportMemory()
+{
+	for(uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
 	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		uint32_t blocks = 0, count = 0;
+		VkDeviceSize used = 0, reserved = 0;
+
+		for(uint32_t index = 0; index < memoryBlockCount; index++)
+		{
+			if(memoryBlocks[index].memory == VK_NULL_HANDLE || memoryBlocks[index].type != type)
+				continue;
+
+			blocks++;
+			count += memoryBlocks[index].count;
+			used += memoryBlocks[index].used;
+			reserved += memoryBlocks[index].size;
+		}
+
+		if(blocks)
+			printlog(1, "Memory Type %u: %u Blocks, %u Allocations, %.3f MB Used of %.3f MB Reserved", type,
+			 blocks, count, used / 1048576.0, reserved / 1048576.0);
 	}
 
-	else if(layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	printlog(1, "Memory Statistics: %lu Live Allocations in %lu Blocks (%lu Peak), %lu Requests, "
+	 "%lu Device Allocations", memoryCount, memoryLive, memoryPeak, memoryRequests, memoryDevice);
+	printlog(1, "Ring Buffer: %.3f KB Peak of %.3f KB per Frame", ringPeak / 1024.0, RING_FRAME / 1024.0);
+	printlog(1, "Memory Fragmentation: %.3f, %lu Texture Relocations", memoryFragmentation(), defragRelocations);
+
+	if(attachmentLazy)
 	{
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT |
-		 (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT
-		 ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
-		 | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		VkDeviceSize committed = 0;
+		vkGetDeviceMemoryCommitment(device, attachmentMemory.memory, &committed);
+		printlog(1, "Attachments: %.3f MB Committed of %.3f MB Lazily Allocated", committed / 1048576.0,
+		 attachmentMemory.size / 1048576.0);
 	}
+	queryMemoryBudget();
+	reportMemoryBudget();
+}
 
-	else
-		printlog(0, NULL);
+void cleanupMemory()
+{
+	printlog(!memoryCount, "Cleanup Memory: %lu Blocks", memoryLive);
 
-	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-	 stage, 0, 0, NULL, 0, NULL, 1, &barrier);
-	endSingleTimeCommand(commandBuffer);
+	for(uint32_t index = 0; index < memoryBlockCount; index++)
+		if(memoryBlocks[index].memory != VK_NULL_HANDLE)
+			destroyMemoryBlock(&memoryBlocks[index]);
+
+	freeHost(memoryBlocks);
 }
 
-void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t imageWidth, uint32_t imageHeight)
+void growHandleTable(HandleTable *table)
 {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommand();
+	table->limit = table->limit ? 2 * table->limit : HANDLE_INITIAL;
+	printlog(table->limit <= HANDLE_SLOT + 1, "%s Handle Table Full", table->name);
 
-	VkBufferImageCopy region = {};
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageOffset = (VkOffset3D){0, 0, 0};
-	region.imageExtent = (VkExtent3D){imageWidth, imageHeight, 1};
+	table->generations = reallocateHost(table->tag, table->generations, table->limit * sizeof(uint32_t));
+	table->next = reallocateHost(table->tag, table->next, table->limit * sizeof(uint32_t));
+	for(uint32_t slot = table->count; slot < table->limit; slot++)
+		table->generations[slot] = 1;
 
-	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-	endSingleTimeCommand(commandBuffer);
+	for(uint32_t column = 0; column < table->columnCount; column++)
+		*table->columns[column] = reallocateHost(table->tag, *table->columns[column],
+		 table->limit * table->sizes[column]);
 }
 
-void createColorBuffer()
+void createHandleTable(HandleTable *table, const char *name, uint32_t tag, void (*destroy)(uint32_t slot),
+ uint32_t columnCount, void **columns[], size_t sizes[])
 {
-	createImage(swapchainExtent.width, swapchainExtent.height, 1, msaaSamples, swapchainFormat,
-	 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-	 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &colorImage, &colorMemory);
-	colorView = createImageView(colorImage, 1, swapchainFormat, VK_IMAGE_ASPECT_COLOR_BIT);
-	transitionImageLayout(colorImage, 1, swapchainFormat, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	*table = (HandleTable){name, tag, 0, 0, UINT32_MAX, 0, NULL, NULL, columnCount, {}, {}, destroy};
+	for(uint32_t column = 0; column < columnCount; column++)
+	{
+		table->columns[column] = columns[column];
+		table->sizes[column] = sizes[column];
+	}
 
-	printlog(1, "Create Color Buffer: %dx MSAA", msaaSamples);
+	growHandleTable(table);
 }
 
-void createDepthBuffer()
+Handle acquireHandle(HandleTable *table)
 {
-	VkFormat depthFormat = chooseDepthFormat();
+	uint32_t slot = table->free;
+
+	if(slot != UINT32_MAX)
+		table->free = table->next[slot];
+	else
+	{
+		if(table->count == table->limit)
+			growHandleTable(table);
+		slot = table->count++;
+	}
 
-	createImage(swapchainExtent.width, swapchainExtent.height, 1, msaaSamples, depthFormat,
-	 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-	 &depthImage, &depthMemory);
-	depthView = createImageView(depthImage, 1, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
-	transitionImageLayout(depthImage, 1, depthFormat, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	table->live++;
+	return table->generations[slot] << HANDLE_BITS | slot;
+}
 
-	printlog(depthFormat >= 0, "Create Depth Buffer");
+uint32_t acquireSlot(HandleTable *table, Handle *handle)
+{
+	*handle = acquireHandle(table);
+	return lookupHandle(table, *handle);
 }
 
-void createFramebuffers()
+uint32_t lookupHandle(HandleTable *table, Handle handle)
 {
-	swapchainFramebuffers = malloc(framebufferSize * sizeof(VkFramebuffer));
+	uint32_t slot = handle & HANDLE_SLOT;
+	if(slot >= table->count || table->generations[slot] != handle >> HANDLE_BITS)
+		printlog(0, "Stale %s Handle: Slot %u, Generation %u", table->name, slot, handle >> HANDLE_BITS);
+	return slot;
+}
 
-	for(uint32_t framebufferIndex = 0; framebufferIndex < framebufferSize; framebufferIndex++)
-	{
-		VkFramebufferCreateInfo framebufferInfo = {};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferInfo.width = swapchainExtent.width;
-		framebufferInfo.height = swapchainExtent.height;
-		framebufferInfo.layers = 1;
-		framebufferInfo.renderPass = renderPass;
-		framebufferInfo.attachmentCount = 3;
-		framebufferInfo.pAttachments = (VkImageView[]){colorView, depthView, swapchainViews[framebufferIndex]};
+void releaseHandle(HandleTable *table, Handle handle)
+{
+	uint32_t slot = lookupHandle(table, handle);
 
-		printlog(vkCreateFramebuffer(device, &framebufferInfo, NULL, &swapchainFramebuffers[framebufferIndex])
-		 == VK_SUCCESS, NULL);
-	}
+	// Bumping the generation is what turns any copy of the old handle into a detectable use after free
+	table->generations[slot] = table->generations[slot] % HANDLE_GENERATIONS + 1;
+	table->next[slot] = table->free;
+	table->free = slot;
+	table->live--;
+}
 
-	printlog(1, "Create Framebuffers: Count = %u", framebufferSize);
+void destroyHandle(HandleTable *table, Handle handle)
+{
+	table->destroy(lookupHandle(table, handle));
+	releaseHandle(table, handle);
 }
 
-void generateMipmaps(VkImage image, int32_t width, int32_t height, uint32_t levels, VkFormat format)
+void destroyLater(HandleTable *table, Handle handle)
 {
-	VkFormatProperties formatProperties;
-	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
-	printlog(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT, NULL);
+	lookupHandle(table, handle);
 
-	VkCommandBuffer commandBuffer = beginSingleTimeCommand();
+	if(handleReleaseCount == handleReleaseLimit)
+		handleReleases = reallocateHost(HOST_DEVICE, handleReleases, (handleReleaseLimit = handleReleaseLimit ?
+		 2 * handleReleaseLimit : 16) * sizeof(HandleRelease));
 
-	VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.image = image;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-	barrier.subresourceRange.levelCount = 1;
+	handleReleases[handleReleaseCount++] = (HandleRelease){table, handle, frameCount};
+	handlesDeferred++;
+}
 
-	int32_t mipWidth = width, mipHeight = height;
-	for (uint32_t mipLevel = 1; mipLevel < levels; mipLevel++)
+void collectHandles(int all)
+{
+	uint32_t kept = 0;
+
+	// The frame timeline has been waited on for every frame older than the frames in flight
+	for(uint32_t index = 0; index < handleReleaseCount; index++)
 	{
-		barrier.subresourceRange.baseMipLevel = mipLevel - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		HandleRelease *release = &handleReleases[index];
 
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		 0, 0, NULL, 0, NULL, 1, &barrier);
+		if(!all && frameCount < release->frame + framebufferLimit)
+			handleReleases[kept++] = *release;
+		else
+			destroyHandle(release->table, release->handle);
+	}
 
-		VkImageBlit blit = {};
-		blit.srcOffsets[0] = (VkOffset3D){0, 0, 0};
-		blit.srcOffsets[1] = (VkOffset3D){mipWidth, mipHeight, 1};
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.mipLevel = mipLevel - 1;
-		blit.srcSubresource.baseArrayLayer = 0;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = (VkOffset3D){0, 0, 0};
-		blit.dstOffsets[1] = (VkOffset3D){mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1};
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.mipLevel = mipLevel;
-		blit.dstSubresource.baseArrayLayer = 0;
-		blit.dstSubresource.layerCount = 1;
+	handleReleaseCount = kept;
+}
 
-		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		 image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+void destroyTextureSlot(uint32_t slot)
+{
+	vkDestroyImageView(device, textureViews[slot], NULL);
+	vkDestroyImage(device, textureImages[slot], NULL);
+	if(textureMemories[slot].memory != VK_NULL_HANDLE)
+		freeMemory(&textureMemories[slot]);
+}
 
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+void destroyBufferSlot(uint32_t slot)
+{
+	vkDestroyBuffer(device, bufferObjects[slot], NULL);
+	freeMemory(&bufferMemories[slot]);
+}
 
-		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-		 0, 0, NULL, 0, NULL, 1, &barrier);
+void destroySamplerSlot(uint32_t slot)
+{
+	vkDestroySampler(device, samplerObjects[slot], NULL);
+}
 
-		if(mipWidth > 1)
-			mipWidth /= 2;
-		if(mipHeight > 1)
-			mipHeight /= 2;
-	}
+void destroyPipelineSlot(uint32_t slot)
+{
+	vkDestroyPipeline(device, pipelineObjects[slot], NULL);
+	vkDestroyPipelineLayout(device, pipelineLayouts[slot], NULL);
+}
 
-	barrier.subresourceRange.baseMipLevel = levels - 1;
-	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+void createHandleTables()
+{
+	createHandleTable(&textureTable, "Texture", HOST_TEXTURE, destroyTextureSlot, 3,
+	 (void**[]){(void**)&textureImages, (void**)&textureViews, (void**)&textureMemories},
+	 (size_t[]){sizeof(VkImage), sizeof(VkImageView), sizeof(Allocation)});
+	createHandleTable(&bufferTable, "Buffer", HOST_DEVICE, destroyBufferSlot, 2,
+	 (void**[]){(void**)&bufferObjects, (void**)&bufferMemories}, (size_t[]){sizeof(VkBuffer), sizeof(Allocation)});
+	createHandleTable(&samplerTable, "Sampler", HOST_DEVICE, destroySamplerSlot, 1,
+	 (void**[]){(void**)&samplerObjects}, (size_t[]){sizeof(VkSampler)});
+	createHandleTable(&pipelineTable, "Pipeline", HOST_PIPELINE, destroyPipelineSlot, 2,
+	 (void**[]){(void**)&pipelineObjects, (void**)&pipelineLayouts}, (size_t[]){sizeof(VkPipeline),
+	 sizeof(VkPipelineLayout)});
+	createHandleTable(&meshTable, "Mesh", HOST_GEOMETRY, NULL, 1, (void**[]){(void**)&meshes},
+	 (size_t[]){sizeof(Mesh)});
+
+	printlog(1, "Create Handle Tables: %u Slot Bits, %u Generations", HANDLE_BITS, HANDLE_GENERATIONS);
+}
 
-	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-	 0, 0, NULL, 0, NULL, 1, &barrier);
+void cleanupHandleTables()
+{
+	HandleTable *tables[] = {&textureTable, &bufferTable, &samplerTable, &pipelineTable, &meshTable};
 
-	endSingleTimeCommand(commandBuffer);
+	for(uint32_t index = 0; index < sizeof(tables) / sizeof(HandleTable*); index++)
+	{
+		HandleTable *table = tables[index];
+		if(table->live && table != &meshTable)
+			printlog(1, "Handle Leak %s: %u Live of %u Slots", table->name, table->live, table->count);
+
+		freeHost(table->generations);
+		freeHost(table->next);
+		for(uint32_t column = 0; column < table->columnCount; column++)
+			freeHost(*table->columns[column]);
+	}
 
-	printlog(1, "Generate Mipmaps: %d Levels", levels);
+	freeHost(handleReleases);
+	printlog(1, "Cleanup Handle Tables: %lu Deferred Destructions", handlesDeferred);
 }
 
-void createTextureImage()
+VkBuffer lookupBuffer(Handle handle)
 {
-	int textureWidth, textureHeight, textureChannels;
-	stbi_uc *pixels = stbi_load("textures/chalet.jpg",
-	 &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha);
-	printlog(pixels != NULL, NULL);
-	mipLevels = floor(log2f(fmaxf(textureWidth, textureHeight))) + 1;
+	return bufferObjects[lookupHandle(&bufferTable, handle)];
+}
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	VkDeviceSize imageSize = textureWidth * textureHeight * 4;
+Allocation *lookupBufferMemory(Handle handle)
+{
+	return &bufferMemories[lookupHandle(&bufferTable, handle)];
+}
 
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-	 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+uint8_t *directMemory(Handle handle)
+{
+	Allocation *memory = lookupBufferMemory(handle);
+	VkMemoryPropertyFlags flags = memoryProperties.memoryTypes[memoryBlocks[memory->block].type].propertyFlags;
+	return memoryDirect && (flags & MEMORY_DIRECT) == MEMORY_DIRECT ? memory->mapped : NULL;
+}
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, imageSize);
-	vkUnmapMemory(device, stagingBufferMemory);
-	stbi_image_free(pixels);
+VkImage lookupImage(Handle handle)
+{
+	return textureImages[lookupHandle(&textureTable, handle)];
+}
 
-	createImage(textureWidth, textureHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM,
-	 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-	 VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &textureImage, &textureMemory);
-	transitionImageLayout(textureImage, mipLevels, VK_FORMAT_R8G8B8A8_UNORM,
-	 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	copyBufferToImage(stagingBuffer, textureImage, textureWidth, textureHeight);
-	generateMipmaps(textureImage, textureWidth, textureHeight, mipLevels, VK_FORMAT_R8G8B8A8_UNORM);
+VkImageView lookupView(Handle handle)
+{
+	return textureViews[lookupHandle(&textureTable, handle)];
+}
 
-	vkDestroyBuffer(device, stagingBuffer, NULL);
-	vkFreeMemory(device, stagingBufferMemory, NULL);
+VkSampler lookupSampler(Handle handle)
+{
+	return samplerObjects[lookupHandle(&samplerTable, handle)];
+}
 
-	textureView = createImageView(textureImage, mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+VkPipeline lookupPipeline(Handle handle)
+{
+	return pipelineObjects[lookupHandle(&pipelineTable, handle)];
 }
 
-void createTextureSampler()
+VkPipelineLayout lookupLayout(Handle handle)
 {
-	VkSamplerCreateInfo samplerInfo = {};
-	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
-	samplerInfo.minFilter = VK_FILTER_LINEAR;
-	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-	samplerInfo.unnormalizedCoordinates = VK_FALSE;
-	samplerInfo.compareEnable = VK_FALSE;
-	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-	samplerInfo.anisotropyEnable = VK_TRUE;
-	samplerInfo.maxAnisotropy = 16;
-	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-	samplerInfo.mipLodBias = 0.0f;
-	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = (float)mipLevels;
+	return pipelineLayouts[lookupHandle(&pipelineTable, handle)];
+}
 
-	printlog(vkCreateSampler(device, &samplerInfo, NULL, &textureSampler) == VK_SUCCESS, "Create Texture Sampler");
+Mesh *lookupMesh(Handle handle)
+{
+	return &meshes[lookupHandle(&meshTable, handle)];
 }
 
-uint16_t hashVertex(Vertex vertex)
+void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+ VkMemoryPropertyFlags properties, VkBuffer *buffer, Allocation *bufferMemory)
 {
-	uint16_t hash = 0;
-	for(uint16_t seed = 0; seed < 16; seed++)
-		hash ^= (vertex.data[seed] << seed) | (vertex.data[seed] >> (16 - seed));
-	return hash;
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.usage = usage;
+	bufferInfo.size = size;
+
+	printlog(vkCreateBuffer(device, &bufferInfo, NULL, buffer) == VK_SUCCESS, NULL);
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetBufferMemoryRequirements(device, *buffer, &memoryRequirements);
+
+	uint32_t category = usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT) ?
+	 MEMORY_GEOMETRY : usage & (VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) ?
+	 MEMORY_FRAME : MEMORY_STAGING;
+	allocateMemory(memoryRequirements, properties, 1, category, bufferMemory);
+	vkBindBufferMemory(device, *buffer, bufferMemory->memory, bufferMemory->offset);
 }
 
-int compareVertex(Vertex v1, Vertex v2)
+Handle createBufferHandle(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
 {
-	return v1.pos[0] == v2.pos[0] && v1.pos[1] == v2.pos[1] && v1.pos[2] == v2.pos[2]
-	 && v1.col[0] == v2.col[0] && v1.col[1] == v2.col[1] && v1.col[2] == v2.col[2] &&
-	 v1.tex[0] == v2.tex[0] && v1.tex[1] == v2.tex[1];
+	Handle handle;
+	uint32_t slot = acquireSlot(&bufferTable, &handle);
+	createBuffer(size, usage, properties, &bufferObjects[slot], &bufferMemories[slot]);
+	return handle;
 }
 
-void loadObject(const char *model, float *origin)
+void createUpload()
 {
-	int file = open(model, O_RDONLY);
-	size_t size = lseek(file, 0, SEEK_END);
-	lseek(file, 0, SEEK_SET);
-	void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
-	close(file);
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = graphicsIndex;
+	printlog(vkCreateCommandPool(device, &poolInfo, NULL, &uploadPool) == VK_SUCCESS, NULL);
+	poolInfo.queueFamilyIndex = transferIndex;
+	printlog(vkCreateCommandPool(device, &poolInfo, NULL, &transferPool) == VK_SUCCESS, NULL);
 
-	size_t shapeCount;
-	size_t materialCount;
-	tinyobj_attrib_t attributes;
-	tinyobj_shape_t* shapes;
-	tinyobj_material_t* materials;
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
 
-	printlog(tinyobj_parse_obj(&attributes, &shapes, &shapeCount, &materials, &materialCount, data, size,
-	 TINYOBJ_FLAG_TRIANGULATE) == TINYOBJ_SUCCESS, "Read Object File: %lu bytes", size);
-	munmap(data, size);
+	for(uint32_t batchIndex = 0; batchIndex < UPLOAD_BATCHES; batchIndex++)
+	{
+		uploadBatches[batchIndex] = (UploadBatch){};
+		allocateInfo.commandPool = uploadPool;
+		printlog(vkAllocateCommandBuffers(device, &allocateInfo, &uploadBatches[batchIndex].graphics) ==
+		 VK_SUCCESS, NULL);
+		allocateInfo.commandPool = transferPool;
+		printlog(vkAllocateCommandBuffers(device, &allocateInfo, &uploadBatches[batchIndex].transfer) ==
+		 VK_SUCCESS, NULL);
+	}
 
-	uint32_t uniqueCount = 0;
+	// Both timelines count batch serials, one when the copies land and one when the whole batch is done
+	VkSemaphoreTypeCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
 
-	for(uint32_t index = 0; index < attributes.num_faces; index++)
-	{
-		Vertex vertex = {{{
-				origin[0] + attributes.vertices[3 * attributes.faces[index].v_idx],
-				origin[1] + attributes.vertices[3 * attributes.faces[index].v_idx + 1],
-				origin[2] - attributes.vertices[3 * attributes.faces[index].v_idx + 2]
-			},{1.0f, 1.0f, 1.0f},{
-				 attributes.texcoords[2 * attributes.faces[index].vt_idx],
-				-attributes.texcoords[2 * attributes.faces[index].vt_idx + 1]
-		}}};
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &timelineInfo;
+	printlog(vkCreateSemaphore(device, &semaphoreInfo, NULL, &uploadTimeline) == VK_SUCCESS, NULL);
+	printlog(vkCreateSemaphore(device, &semaphoreInfo, NULL, &transferTimeline) == VK_SUCCESS, NULL);
+
+	uploadRing = createBufferHandle(UPLOAD_RING, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+	 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	uploadMapped = lookupBufferMemory(uploadRing)->mapped;
+
+	printlog(1, "Create Upload Batches: %u Batches, %.3f MB Staging Ring, Transfer Queue Index = %u", UPLOAD_BATCHES,
+	 UPLOAD_RING / 1048576.0, transferIndex);
+}
+
+uint64_t timelineValue(VkSemaphore semaphore)
+{
+	uint64_t value = 0;
+	vkGetSemaphoreCounterValue(device, semaphore, &value);
+	return value;
+}
+
+void waitTimeline(VkSemaphore semaphore, uint64_t value)
+{
+	VkSemaphoreWaitInfo waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+	vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+}
+
+void retireUpload()
+{
+	UploadBatch *batch = &uploadBatches[uploadRetired % UPLOAD_BATCHES];
+	waitTimeline(uploadTimeline, uploadRetired);
+
+	for(uint32_t index = 0; index < batch->bufferCount; index++)
+		destroyHandle(&bufferTable, batch->buffers[index]);
+	for(uint32_t index = 0; index < batch->viewCount; index++)
+		vkDestroyImageView(device, batch->views[index], NULL);
+	for(uint32_t index = 0; index < batch->poolCount; index++)
+		vkDestroyDescriptorPool(device, batch->pools[index], NULL);
+
+	batch->bufferCount = batch->viewCount = batch->poolCount = 0;
+	uploadTail = batch->head;
+	uploadRetired++;
+}
+
+UploadBatch *openUpload()
+{
+	UploadBatch *batch = &uploadBatches[uploadSerial % UPLOAD_BATCHES];
+	if(uploadOpen)
+		return batch;
+
+	// Reusing a batch slot means the batch submitted UPLOAD_BATCHES ago has to be done first
+	while(uploadSerial - uploadRetired >= UPLOAD_BATCHES)
+		retireUpload();
+
+	batch->transferred = batch->recorded = 0;
+	uploadOpen = 1;
+	return batch;
+}
+
+void beginBatchCommands(VkCommandBuffer commandBuffer)
+{
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(commandBuffer, 0);
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+}
+
+VkCommandBuffer beginUpload()
+{
+	UploadBatch *batch = openUpload();
+	if(!batch->recorded)
+		beginBatchCommands(batch->graphics);
+	batch->recorded = 1;
+	return batch->graphics;
+}
+
+VkCommandBuffer beginTransfer()
+{
+	UploadBatch *batch = openUpload();
+	if(!batch->transferred)
+		beginBatchCommands(batch->transfer);
+	batch->transferred = 1;
+	return batch->transfer;
+}
+
+uint64_t submitUpload()
+{
+	if(!uploadOpen)
+		return uploadSerial - 1;
+
+	UploadBatch *batch = &uploadBatches[uploadSerial % UPLOAD_BATCHES];
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	batch->head = uploadHead;
+
+	if(batch->transferred)
+	{
+		vkEndCommandBuffer(batch->transfer);
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &uploadSerial;
+
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &batch->transfer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &transferTimeline;
+
+		vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		uploadTransfers++;
+	}
+
+	if(batch->recorded)
+		vkEndCommandBuffer(batch->graphics);
+
+	// A batch without graphics work is an empty submission, its wait holds back nothing else on the graphics queue
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = batch->transferred;
+	timelineInfo.pWaitSemaphoreValues = &uploadSerial;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &uploadSerial;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = batch->transferred;
+	submitInfo.pWaitSemaphores = &transferTimeline;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = batch->recorded;
+	submitInfo.pCommandBuffers = &batch->graphics;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &uploadTimeline;
+
+	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	uploadOpen = 0;
+	uploadSubmits++;
+	return uploadSerial++;
+}
+
+void waitUpload(uint64_t serial)
+{
+	if(serial >= uploadSerial)
+		serial = submitUpload();
+
+	if(uploadRetired <= serial)
+		uploadWaits++;
+	while(uploadRetired <= serial)
+		retireUpload();
+}
+
+void collectUploads()
+{
+	uint64_t completed = timelineValue(uploadTimeline);
+	while(uploadRetired < uploadSerial && uploadRetired <= completed)
+		retireUpload();
+}
+
+int transferComplete(uint64_t serial)
+{
+	return timelineValue(transferTimeline) >= serial;
+}
+
+void *stageUpload(VkDeviceSize size, VkBuffer *buffer, VkDeviceSize *offset)
+{
+	// Must come before the caller's beginUpload, since making room may submit the open batch
+	uploadStaged += size;
+
+	if(size > UPLOAD_RING / 4)
+	{
+		UploadBatch *batch = openUpload();
+		if(batch->bufferCount == batch->bufferLimit)
+			batch->buffers = reallocateHost(HOST_DEVICE, batch->buffers, (batch->bufferLimit = batch->bufferLimit ?
+			 2 * batch->bufferLimit : 4) * sizeof(Handle));
+
+		Handle temporary = createBufferHandle(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		batch->buffers[batch->bufferCount++] = temporary;
+		*buffer = lookupBuffer(temporary);
+		*offset = 0;
+		return lookupBufferMemory(temporary)->mapped;
+	}
+
+	VkDeviceSize position = (uploadHead + UPLOAD_ALIGNMENT - 1) & ~(VkDeviceSize)(UPLOAD_ALIGNMENT - 1);
+	if(position / UPLOAD_RING != (position + size - 1) / UPLOAD_RING)
+		position = (position / UPLOAD_RING + 1) * UPLOAD_RING;
+
+	while(position + size - uploadTail > UPLOAD_RING)
+	{
+		if(uploadRetired == uploadSerial)
+			submitUpload();
+		uploadWaits++;
+		retireUpload();
+	}
+
+	// Ring space always belongs to the open batch, so it is released together with that batch
+	openUpload();
+	uploadHead = position + size;
+	uploadPeak = uploadHead - uploadTail > uploadPeak ? uploadHead - uploadTail : uploadPeak;
+	*buffer = lookupBuffer(uploadRing);
+	*offset = position % UPLOAD_RING;
+	return uploadMapped + *offset;
+}
+
+void deferUploadView(VkImageView view)
+{
+	UploadBatch *batch = &uploadBatches[uploadSerial % UPLOAD_BATCHES];
+	if(batch->viewCount == batch->viewLimit)
+		batch->views = reallocateHost(HOST_DEVICE, batch->views, (batch->viewLimit = batch->viewLimit ?
+		 2 * batch->viewLimit : 16) * sizeof(VkImageView));
+	batch->views[batch->viewCount++] = view;
+}
+
+void deferUploadPool(VkDescriptorPool pool)
+{
+	UploadBatch *batch = &uploadBatches[uploadSerial % UPLOAD_BATCHES];
+	if(batch->poolCount == batch->poolLimit)
+		batch->pools = reallocateHost(HOST_DEVICE, batch->pools, (batch->poolLimit = batch->poolLimit ?
+		 2 * batch->poolLimit : 4) * sizeof(VkDescriptorPool));
+	batch->pools[batch->poolCount++] = pool;
+}
+
+void cleanupUpload()
+{
+	waitUpload(submitUpload());
+
+	for(uint32_t batchIndex = 0; batchIndex < UPLOAD_BATCHES; batchIndex++)
+	{
+		freeHost(uploadBatches[batchIndex].buffers);
+		freeHost(uploadBatches[batchIndex].views);
+		freeHost(uploadBatches[batchIndex].pools);
+	}
+
+	vkDestroySemaphore(device, transferTimeline, NULL);
+	vkDestroySemaphore(device, uploadTimeline, NULL);
+	vkDestroyCommandPool(device, transferPool, NULL);
+	vkDestroyCommandPool(device, uploadPool, NULL);
+	destroyHandle(&bufferTable, uploadRing);
+}
+
+void createCompute()
+{
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = computeIndex;
+	printlog(vkCreateCommandPool(device, &poolInfo, NULL, &computePool) == VK_SUCCESS, NULL);
+
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = computePool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	computeFrames = allocateHostZeroed(HOST_DEVICE, framebufferLimit, sizeof(ComputeFrame));
+	for(uint32_t frameIndex = 0; frameIndex < framebufferLimit; frameIndex++)
+		printlog(vkAllocateCommandBuffers(device, &allocateInfo, &computeFrames[frameIndex].commandBuffer) ==
+		 VK_SUCCESS, NULL);
+
+	VkSemaphoreTypeCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &timelineInfo;
+	printlog(vkCreateSemaphore(device, &semaphoreInfo, NULL, &computeTimeline) == VK_SUCCESS,
+	 "Create Compute Stage: %s Queue, Queue Index = %u", computeIndex == graphicsIndex ? "Shared" : "Async",
+	 computeIndex);
+}
+
+void retireCompute(ComputeFrame *frame)
+{
+	for(uint32_t index = 0; index < frame->viewCount; index++)
+		vkDestroyImageView(device, frame->views[index], NULL);
+	for(uint32_t index = 0; index < frame->poolCount; index++)
+		vkDestroyDescriptorPool(device, frame->pools[index], NULL);
+
+	frame->viewCount = frame->poolCount = 0;
+	frame->submitted = 0;
+}
+
+void beginComputeFrame(uint32_t frameIndex)
+{
+	// The slot's frame has retired on the timeline, and it waited on its compute work, so that work is done too
+	computeSlot = frameIndex;
+	if(computeFrames[frameIndex].submitted)
+		retireCompute(&computeFrames[frameIndex]);
+}
+
+VkCommandBuffer beginCompute()
+{
+	ComputeFrame *frame = &computeFrames[computeSlot];
+	if(frame->recorded)
+		return frame->commandBuffer;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkResetCommandBuffer(frame->commandBuffer, 0);
+	vkBeginCommandBuffer(frame->commandBuffer, &beginInfo);
+	frame->recorded = 1;
+	frame->transferValue = 0;
+	return frame->commandBuffer;
+}
+
+void waitComputeTransfer(uint64_t serial)
+{
+	ComputeFrame *frame = &computeFrames[computeSlot];
+	frame->transferValue = serial > frame->transferValue ? serial : frame->transferValue;
+}
+
+void deferComputeView(VkImageView view)
+{
+	ComputeFrame *frame = &computeFrames[computeSlot];
+	if(frame->viewCount == frame->viewLimit)
+		frame->views = reallocateHost(HOST_DEVICE, frame->views, (frame->viewLimit = frame->viewLimit ?
+		 2 * frame->viewLimit : 16) * sizeof(VkImageView));
+	frame->views[frame->viewCount++] = view;
+}
+
+void deferComputePool(VkDescriptorPool pool)
+{
+	ComputeFrame *frame = &computeFrames[computeSlot];
+	if(frame->poolCount == frame->poolLimit)
+		frame->pools = reallocateHost(HOST_DEVICE, frame->pools, (frame->poolLimit = frame->poolLimit ?
+		 2 * frame->poolLimit : 4) * sizeof(VkDescriptorPool));
+	frame->pools[frame->poolCount++] = pool;
+}
+
+void deferComputeAcquire(VkImageMemoryBarrier barrier)
+{
+	ComputeFrame *frame = &computeFrames[computeSlot];
+	if(frame->acquireCount == frame->acquireLimit)
+		frame->acquires = reallocateHost(HOST_DEVICE, frame->acquires, (frame->acquireLimit = frame->acquireLimit ?
+		 2 * frame->acquireLimit : 4) * sizeof(VkImageMemoryBarrier));
+	frame->acquires[frame->acquireCount++] = barrier;
+}
+
+uint64_t submitCompute()
+{
+	ComputeFrame *frame = &computeFrames[computeSlot];
+	if(!frame->recorded)
+		return 0;
+
+	vkEndCommandBuffer(frame->commandBuffer);
+	computeSerial++;
+
+	// Copies this work consumes have landed before it was recorded, so the wait only carries the memory dependency
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timelineInfo.waitSemaphoreValueCount = frame->transferValue ? 1 : 0;
+	timelineInfo.pWaitSemaphoreValues = &frame->transferValue;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &computeSerial;
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = &timelineInfo;
+	submitInfo.waitSemaphoreCount = frame->transferValue ? 1 : 0;
+	submitInfo.pWaitSemaphores = &transferTimeline;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &frame->commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &computeTimeline;
+
+	vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	frame->recorded = 0;
+	frame->submitted = 1;
+	computeSubmits++;
+	return computeSerial;
+}
+
+uint32_t acquireCompute(VkCommandBuffer commandBuffer)
+{
+	// Images released by the compute family are taken over by the frame that waits on the compute timeline
+	ComputeFrame *frame = &computeFrames[computeSlot];
+	uint32_t count = frame->acquireCount;
+	if(count)
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, count, frame->acquires);
+	frame->acquireCount = 0;
+	return count;
+}
+
+void reportCompute()
+{
+	printlog(1, "Compute: %lu Submissions, %lu Dispatches on the %s Compute Queue", computeSubmits,
+	 computeDispatches, computeIndex == graphicsIndex ? "Shared" : "Async");
+}
+
+void cleanupCompute()
+{
+	for(uint32_t frameIndex = 0; frameIndex < framebufferLimit; frameIndex++)
+	{
+		if(computeFrames[frameIndex].recorded)
+			vkEndCommandBuffer(computeFrames[frameIndex].commandBuffer);
+		retireCompute(&computeFrames[frameIndex]);
+		freeHost(computeFrames[frameIndex].views);
+		freeHost(computeFrames[frameIndex].pools);
+		freeHost(computeFrames[frameIndex].acquires);
+	}
+
+	freeHost(computeFrames);
+	vkDestroySemaphore(device, computeTimeline, NULL);
+	vkDestroyCommandPool(device, computePool, NULL);
+}
+
+void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+{
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = 0;
+	copyRegion.dstOffset = 0;
+	copyRegion.size = size;
+
+	vkCmdCopyBuffer(beginUpload(), srcBuffer, dstBuffer, 1, &copyRegion);
+}
+
+void createImage(uint32_t imageWidth, uint32_t imageHeight, uint32_t levels, uint32_t layers,
+ VkSampleCountFlagBits samples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+ VkImage *image, Allocation *memory)
+{
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.samples = samples;
+	imageInfo.format = format;
+	imageInfo.tiling = tiling;
+	imageInfo.usage = usage;
+	imageInfo.extent.width = imageWidth;
+	imageInfo.extent.height = imageHeight;
+	imageInfo.mipLevels = levels;
+	imageInfo.arrayLayers = layers;
+	imageInfo.extent.depth = 1;
+
+	printlog(vkCreateImage(device, &imageInfo, NULL, image) == VK_SUCCESS,
+	 "Create Image: %u x %u", imageWidth, imageHeight);
+
+	if(!memory)
+		return;
+
+	VkMemoryRequirements memoryRequirements;
+	vkGetImageMemoryRequirements(device, *image, &memoryRequirements);
+
+	allocateMemory(memoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR,
+	 usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) ?
+	 MEMORY_ATTACHMENT : MEMORY_TEXTURE, memory);
+	if(memory->memory != VK_NULL_HANDLE)
+		vkBindImageMemory(device, *image, memory->memory, memory->offset);
+}
+
+Handle createTextureHandle(uint32_t imageWidth, uint32_t imageHeight, uint32_t levels, uint32_t layers,
+ VkFormat format, VkImageUsageFlags usage)
+{
+	Handle handle;
+	uint32_t slot = acquireSlot(&textureTable, &handle);
+
+	textureViews[slot] = VK_NULL_HANDLE;
+	createImage(imageWidth, imageHeight, levels, layers, VK_SAMPLE_COUNT_1_BIT, format, VK_IMAGE_TILING_OPTIMAL,
+	 usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &textureImages[slot], &textureMemories[slot]);
+	return handle;
+}
+
+void transitionImageLayout(VkImage image, uint32_t levels, uint32_t layers, VkFormat format, VkImageLayout layout)
+{
+	VkCommandBuffer commandBuffer = beginUpload();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = layout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.levelCount = levels;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.layerCount = layers;
+	barrier.subresourceRange.baseArrayLayer = 0;
+ 	barrier.srcAccessMask = 0;
+
+	VkPipelineStageFlags stage = 0;
+
+	if(layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+	{
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	}
+
+	else if(layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+	{
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	}
+
+	else if(layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+	{
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT |
+		 (format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT
+		 ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+		 | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	}
+
+	else
+		printlog(0, NULL);
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+	 stage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+VkImageMemoryBarrier imageOwnership(VkImage image, uint32_t levels, uint32_t layers, uint32_t family)
+{
+	// With a shared family the barrier only orders the copy against later use on the same queue
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.image = image;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.srcQueueFamilyIndex = transferIndex == family ? VK_QUEUE_FAMILY_IGNORED : transferIndex;
+	barrier.dstQueueFamilyIndex = transferIndex == family ? VK_QUEUE_FAMILY_IGNORED : family;
+	barrier.subresourceRange = (VkImageSubresourceRange){VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, layers};
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	return barrier;
+}
+
+VkBufferMemoryBarrier bufferOwnership(VkBuffer buffer)
+{
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.buffer = buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	barrier.srcQueueFamilyIndex = transferIndex == graphicsIndex ? VK_QUEUE_FAMILY_IGNORED : transferIndex;
+	barrier.dstQueueFamilyIndex = transferIndex == graphicsIndex ? VK_QUEUE_FAMILY_IGNORED : graphicsIndex;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	return barrier;
+}
+
+void acquireImage(VkCommandBuffer commandBuffer, VkImage image, uint32_t levels, uint32_t layers, uint32_t family)
+{
+	// The release half was recorded on the transfer queue, whose timeline is waited on before this runs
+	VkImageMemoryBarrier barrier = imageOwnership(image, levels, layers, family);
+	barrier.srcAccessMask = transferIndex == family ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, transferIndex == family ? VK_PIPELINE_STAGE_TRANSFER_BIT :
+	 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+	 NULL, 0, NULL, 1, &barrier);
+}
+
+void acquireBuffer(VkBuffer buffer)
+{
+	VkBufferMemoryBarrier barrier = bufferOwnership(buffer);
+	barrier.srcAccessMask = transferIndex == graphicsIndex ? VK_ACCESS_TRANSFER_WRITE_BIT : 0;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+	 VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	vkCmdPipelineBarrier(beginUpload(), transferIndex == graphicsIndex ? VK_PIPELINE_STAGE_TRANSFER_BIT :
+	 VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+	 NULL, 1, &barrier, 0, NULL);
+}
+
+void copyBufferToImage(VkBuffer buffer, VkDeviceSize offset, VkImage image, uint32_t imageWidth, uint32_t imageHeight,
+ uint32_t levels, uint32_t layers, uint32_t family)
+{
+	VkCommandBuffer commandBuffer = beginTransfer();
+
+	// The image is new, so it is moved out of the undefined layout here rather than on the consuming queue
+	VkImageMemoryBarrier barrier = imageOwnership(image, levels, layers, family);
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL,
+	 0, NULL, 1, &barrier);
+
+	VkBufferImageCopy region = {};
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = layers;
+	region.bufferOffset = offset;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageOffset = (VkOffset3D){0, 0, 0};
+	region.imageExtent = (VkExtent3D){imageWidth, imageHeight, 1};
+
+	vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+	if(transferIndex != family)
+	{
+		barrier = imageOwnership(image, levels, layers, family);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		 0, NULL, 0, NULL, 1, &barrier);
+	}
+}
+
+void createColorBuffer()
+{
+	createImage(swapchainExtent.width, swapchainExtent.height, 1, 1, msaaSamples, swapchainFormat,
+	 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+	 0, &colorImage, NULL);
+
+	printlog(1, "Create Color Buffer: %dx MSAA", msaaSamples);
+}
+
+void createDepthBuffer()
+{
+	VkFormat depthFormat = chooseDepthFormat();
+
+	createImage(swapchainExtent.width, swapchainExtent.height, 1, 1, msaaSamples, depthFormat,
+	 VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+	 0, &depthImage, NULL);
+
+	printlog(depthFormat >= 0, "Create Depth Buffer");
+}
+
+void bindAttachments()
+{
+	VkMemoryRequirements colorRequirements, depthRequirements;
+	vkGetImageMemoryRequirements(device, colorImage, &colorRequirements);
+	vkGetImageMemoryRequirements(device, depthImage, &depthRequirements);
+
+	// Both attachments are cleared on load and never stored, so tilers can keep them on chip entirely
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+	VkMemoryRequirements requirements = {};
+	requirements.memoryTypeBits = colorRequirements.memoryTypeBits & depthRequirements.memoryTypeBits;
+	requirements.alignment = colorRequirements.alignment > depthRequirements.alignment ?
+	 colorRequirements.alignment : depthRequirements.alignment;
+	attachmentDepth = (colorRequirements.size + depthRequirements.alignment - 1) /
+	 depthRequirements.alignment * depthRequirements.alignment;
+	requirements.size = attachmentDepth + depthRequirements.size;
+
+	attachmentLazy = 0;
+	for(uint32_t type = 0; type < memoryProperties.memoryTypeCount; type++)
+		if(requirements.memoryTypeBits & (1 << type) &&
+		 (memoryProperties.memoryTypes[type].propertyFlags & properties) == properties)
+			attachmentLazy = 1;
+
+	// Otherwise both images share one pool
+	if(!attachmentLazy)
+		properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+	// Attachments of a retiring swapchain may still render into the old pool, so it is released along with them
+	// and the new attachments never alias it
+	if(attachmentMemory.memory != VK_NULL_HANDLE && retiredCount)
+	{
+		retiredSwapchains[retiredCount - 1].memory = attachmentMemory;
+		attachmentMemory = (Allocation){};
+	}
+
+	// Without a swapchain in flight the pool is only replaced when it has to grow
+	if(requirements.size > attachmentMemory.size)
+	{
+		if(attachmentMemory.memory != VK_NULL_HANDLE)
+			freeMemory(&attachmentMemory);
+		allocateMemory(requirements, properties, 0, MEMORY_ATTACHMENT, &attachmentMemory);
+	}
+
+	vkBindImageMemory(device, colorImage, attachmentMemory.memory, attachmentMemory.offset);
+	vkBindImageMemory(device, depthImage, attachmentMemory.memory, attachmentMemory.offset + attachmentDepth);
+	colorView = createImageView(colorImage, 1, swapchainFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+	depthView = createImageView(depthImage, 1, chooseDepthFormat(), VK_IMAGE_ASPECT_DEPTH_BIT);
+
+	printlog(1, "Bind Attachments: %.3f MB %s, %.3f MB Reserved", requirements.size / 1048576.0,
+	 attachmentLazy ? "Lazily Allocated" : "Shared Pool", attachmentMemory.size / 1048576.0);
+}
+
+void createFramebuffers()
+{
+	swapchainFramebuffers = NULL;
+	if(dynamicRendering)
+		return;
+
+	swapchainFramebuffers = allocateHost(HOST_SWAPCHAIN, framebufferSize * sizeof(VkFramebuffer));
+
+	for(uint32_t framebufferIndex = 0; framebufferIndex < framebufferSize; framebufferIndex++)
+	{
+		VkFramebufferCreateInfo framebufferInfo = {};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.width = swapchainExtent.width;
+		framebufferInfo.height = swapchainExtent.height;
+		framebufferInfo.layers = 1;
+		framebufferInfo.renderPass = renderPass;
+		framebufferInfo.attachmentCount = 3;
+		framebufferInfo.pAttachments = (VkImageView[]){colorView, depthView, swapchainViews[framebufferIndex]};
+
+		printlog(vkCreateFramebuffer(device, &framebufferInfo, NULL, &swapchainFramebuffers[framebufferIndex])
+		 == VK_SUCCESS, NULL);
+	}
+
+	printlog(1, "Create Framebuffers: Count = %u", framebufferSize);
+}
+
+void blitMipmaps(VkImage image, int32_t width, int32_t height, uint32_t levels, uint32_t layers, VkFormat format)
+{
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+	printlog(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT, NULL);
+
+	VkCommandBuffer commandBuffer = beginUpload();
+
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.image = image;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = layers;
+	barrier.subresourceRange.levelCount = 1;
+
+	int32_t mipWidth = width, mipHeight = height;
+	for (uint32_t mipLevel = 1; mipLevel < levels; mipLevel++)
+	{
+		barrier.subresourceRange.baseMipLevel = mipLevel - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		 0, 0, NULL, 0, NULL, 1, &barrier);
+
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = (VkOffset3D){0, 0, 0};
+		blit.srcOffsets[1] = (VkOffset3D){mipWidth, mipHeight, 1};
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = mipLevel - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = layers;
+		blit.dstOffsets[0] = (VkOffset3D){0, 0, 0};
+		blit.dstOffsets[1] = (VkOffset3D){mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1};
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = mipLevel;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = layers;
+
+		vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		 image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		 0, 0, NULL, 0, NULL, 1, &barrier);
+
+		if(mipWidth > 1)
+			mipWidth /= 2;
+		if(mipHeight > 1)
+			mipHeight /= 2;
+	}
+
+	barrier.subresourceRange.baseMipLevel = levels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	 0, 0, NULL, 0, NULL, 1, &barrier);
+
+	printlog(1, "Generate Mipmaps: %d Levels", levels);
+}
+
+double measureTime()
+{
+	struct timespec moment;
+	clock_gettime(CLOCK_MONOTONIC, &moment);
+	return moment.tv_sec + moment.tv_nsec / 1e9;
+}
+
+void stageBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	memcpy(stageUpload(size, &stagingBuffer, &stagingOffset), data, size);
+
+	VkCommandBuffer commandBuffer = beginTransfer();
+	vkCmdCopyBuffer(commandBuffer, stagingBuffer, buffer, 1, &(VkBufferCopy){stagingOffset, offset, size});
+
+	if(transferIndex != graphicsIndex)
+	{
+		VkBufferMemoryBarrier barrier = bufferOwnership(buffer);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+		 0, NULL, 1, &barrier, 0, NULL);
+	}
+
+	acquireBuffer(buffer);
+}
+
+void uploadBuffer(Handle buffer, VkDeviceSize offset, const void *data, VkDeviceSize size)
+{
+	uint8_t *mapped = directMemory(buffer);
+	double start = measureTime();
+
+	// Coherent writes become visible to the device at the next submission, so no copy or wait is needed
+	if(mapped)
+	{
+		memcpy(mapped + offset, data, size);
+		uploadDirect += size;
+		uploadDirectTime += measureTime() - start;
+		uploadCopies++;
+	}
+
+	else
+		stageBuffer(lookupBuffer(buffer), offset, data, size);
+}
+
+void benchmarkUpload()
+{
+	uint32_t iterations = 8;
+	uint8_t *data = allocateHostZeroed(HOST_GEOMETRY, UPLOAD_BENCHMARK, 1);
+	double directTime = 0.0, stagedTime = 0.0;
+
+	Handle buffer = createBufferHandle(UPLOAD_BENCHMARK, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	 memoryDirect ? MEMORY_DIRECT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	uint8_t *mapped = directMemory(buffer);
+
+	for(uint32_t iteration = 0; iteration < iterations; iteration++)
+	{
+		double start = measureTime();
+		stageBuffer(lookupBuffer(buffer), 0, data, UPLOAD_BENCHMARK);
+		waitUpload(submitUpload());
+		stagedTime += measureTime() - start;
+
+		if(mapped)
+		{
+			start = measureTime();
+			memcpy(mapped, data, UPLOAD_BENCHMARK);
+			directTime += measureTime() - start;
+		}
+	}
+
+	destroyHandle(&bufferTable, buffer);
+	freeHost(data);
+
+	uploadStagedRate = stagedTime / iterations / UPLOAD_BENCHMARK;
+	uploadDirectRate = directTime / iterations / UPLOAD_BENCHMARK;
+	printlog(1, "Upload Benchmark: Staged %.3f ms, Direct %s (%.3f MB)", 1000.0 * stagedTime / iterations,
+	 mapped ? "Measured" : "Unavailable", UPLOAD_BENCHMARK / 1048576.0);
+	if(mapped)
+		printlog(1, "Upload Benchmark: Direct %.3f ms", 1000.0 * directTime / iterations);
+}
+
+void reportUpload()
+{
+	printlog(1, "Upload: %.3f MB Written in Place in %.3f ms, %lu Staging Copies Avoided", uploadDirect / 1048576.0,
+	 1000.0 * uploadDirectTime, uploadCopies);
+	printlog(1, "Upload: %.3f MB Staged in %lu Batches, %lu on the %s Transfer Queue, %lu Waits, %.3f MB Peak Ring Usage",
+	 uploadStaged / 1048576.0, uploadSubmits, uploadTransfers, transferIndex == graphicsIndex ? "Shared" : "Dedicated",
+	 uploadWaits, uploadPeak / 1048576.0);
+	if(uploadDirect && uploadStagedRate > 0.0)
+		printlog(1, "Upload: %.3f ms Saved against Staging at the Benchmark Rate",
+		 1000.0 * uploadDirect * (uploadStagedRate - uploadDirectRate));
+}
+
+void createMipmapPipeline()
+{
+	VkDescriptorSetLayoutBinding sourceLayoutBinding = {};
+	sourceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	sourceLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	sourceLayoutBinding.descriptorCount = 1;
+	sourceLayoutBinding.binding = 0;
+
+	VkDescriptorSetLayoutBinding levelLayoutBinding = {};
+	levelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	levelLayoutBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	levelLayoutBinding.descriptorCount = MIPMAP_LEVELS;
+	levelLayoutBinding.binding = 1;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 2;
+	layoutInfo.pBindings = (VkDescriptorSetLayoutBinding[]){sourceLayoutBinding, levelLayoutBinding};
+
+	printlog(vkCreateDescriptorSetLayout(device, &layoutInfo, NULL, &mipmapSetLayout) == VK_SUCCESS, NULL);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &mipmapSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &(VkPushConstantRange){VK_SHADER_STAGE_COMPUTE_BIT, 0,
+	 5 * sizeof(uint32_t)};
+
+	uint32_t slot = acquireSlot(&pipelineTable, &mipmapPipeline);
+	printlog(vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &pipelineLayouts[slot]) == VK_SUCCESS, NULL);
+
+	mipmapShader = initializeShaderModule("Mipmap", "shaders/mipmap.spv");
+
+	VkPipelineShaderStageCreateInfo computeStageInfo = {};
+	computeStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computeStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeStageInfo.module = mipmapShader;
+	computeStageInfo.pName = "main";
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = computeStageInfo;
+	pipelineInfo.layout = pipelineLayouts[slot];
+
+	double start = measureTime();
+	printlog(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, NULL, &pipelineObjects[slot])
+	 == VK_SUCCESS, NULL);
+	pipelineTime += measureTime() - start;
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+
+	printlog(vkCreateSampler(device, &samplerInfo, NULL,
+	 &samplerObjects[acquireSlot(&samplerTable, &mipmapSampler)]) == VK_SUCCESS,
+	 "Create Mipmap Pipeline: %s", mipmapStorage ? "Compute" : "Blit Fallback");
+}
+
+int storageMipmaps(VkFormat format)
+{
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+	return mipmapStorage && formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+}
+
+void queueMipmaps(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t levels,
+ uint32_t layers, uint32_t filter, uint32_t srgb)
+{
+	if(!storageMipmaps(format))
+	{
+		blitMipmaps(image, width, height, levels, layers, format);
+		return;
+	}
+
+	if(mipmapCount == MIPMAP_BATCH)
+		generateMipmaps();
+
+	mipmapRequests[mipmapCount++] = (MipmapRequest){image, format, width, height, levels, layers, filter, srgb};
+}
+
+void recordMipmaps(VkCommandBuffer commandBuffer, int compute)
+{
+	uint32_t setCount = 0, viewCount = 0, rounds = 0, barriers = 0;
+
+	for(uint32_t requestIndex = 0; requestIndex < mipmapCount; requestIndex++)
+	{
+		MipmapRequest *request = &mipmapRequests[requestIndex];
+		uint32_t step = request->filter == MIPMAP_KAISER ? 1 : MIPMAP_LEVELS;
+		uint32_t dispatches = (request->levels - 1 + step - 1) / step;
+
+		setCount += dispatches;
+		viewCount += request->levels;
+		rounds = dispatches > rounds ? dispatches : rounds;
+	}
+
+	VkDescriptorPoolSize sourceSize = {};
+	sourceSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	sourceSize.descriptorCount = setCount ? setCount : 1;
+
+	VkDescriptorPoolSize levelSize = {};
+	levelSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	levelSize.descriptorCount = (setCount ? setCount : 1) * MIPMAP_LEVELS;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = setCount ? setCount : 1;
+	poolInfo.poolSizeCount = 2;
+	poolInfo.pPoolSizes = (VkDescriptorPoolSize[]){sourceSize, levelSize};
+
+	VkDescriptorPool pool;
+	printlog(vkCreateDescriptorPool(device, &poolInfo, NULL, &pool) == VK_SUCCESS, NULL);
+
+	VkDescriptorSet *sets = allocateHost(HOST_TEXTURE, (setCount ? setCount : 1) * sizeof(VkDescriptorSet));
+	VkDescriptorSetLayout *layouts = allocateHost(HOST_TEXTURE, (setCount ? setCount : 1) * sizeof(VkDescriptorSetLayout));
+	for(uint32_t setIndex = 0; setIndex < setCount; setIndex++)
+		layouts[setIndex] = mipmapSetLayout;
+
+	VkDescriptorSetAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocateInfo.descriptorPool = pool;
+	allocateInfo.descriptorSetCount = setCount;
+	allocateInfo.pSetLayouts = layouts;
+
+	printlog(!setCount || vkAllocateDescriptorSets(device, &allocateInfo, sets) == VK_SUCCESS, NULL);
+	freeHost(layouts);
+
+	VkImageView *views = allocateHost(HOST_TEXTURE, viewCount * sizeof(VkImageView));
+	uint32_t *firstViews = allocateHost(HOST_TEXTURE, mipmapCount * sizeof(uint32_t));
+
+	for(uint32_t requestIndex = 0, viewIndex = 0; requestIndex < mipmapCount; requestIndex++)
+	{
+		MipmapRequest *request = &mipmapRequests[requestIndex];
+		firstViews[requestIndex] = viewIndex;
+
+		for(uint32_t level = 0; level < request->levels; level++, viewIndex++)
+		{
+			VkImageViewCreateInfo viewInfo = {};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+			viewInfo.image = request->image;
+			viewInfo.format = request->format;
+			viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+			viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.baseMipLevel = level;
+			viewInfo.subresourceRange.layerCount = request->layers;
+			viewInfo.subresourceRange.baseArrayLayer = 0;
+
+			printlog(vkCreateImageView(device, &viewInfo, NULL, &views[viewIndex]) == VK_SUCCESS, NULL);
+		}
+	}
+
+	VkImageMemoryBarrier *imageBarriers = allocateHost(HOST_TEXTURE, mipmapCount * sizeof(VkImageMemoryBarrier));
+	for(uint32_t requestIndex = 0; requestIndex < mipmapCount; requestIndex++)
+	{
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.image = mipmapRequests[requestIndex].image;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = mipmapRequests[requestIndex].levels;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.layerCount = mipmapRequests[requestIndex].layers;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarriers[requestIndex] = barrier;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+	 0, 0, NULL, 0, NULL, mipmapCount, imageBarriers);
+	VkPipelineLayout mipmapLayout = lookupLayout(mipmapPipeline);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, lookupPipeline(mipmapPipeline));
+
+	VkMemoryBarrier roundBarrier = {};
+	roundBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	roundBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	roundBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	for(uint32_t round = 0, setIndex = 0; round < rounds; round++)
+	{
+		if(round)
+		{
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			 VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &roundBarrier, 0, NULL, 0, NULL);
+			barriers++;
+		}
+
+		for(uint32_t requestIndex = 0; requestIndex < mipmapCount; requestIndex++)
+		{
+			MipmapRequest *request = &mipmapRequests[requestIndex];
+			uint32_t step = request->filter == MIPMAP_KAISER ? 1 : MIPMAP_LEVELS;
+			uint32_t base = round * step;
+
+			if(base + 1 >= request->levels)
+				continue;
+
+			uint32_t count = request->levels - 1 - base < step ? request->levels - 1 - base : step;
+			VkImageView *levelViews = &views[firstViews[requestIndex] + base];
+
+			VkDescriptorImageInfo sourceInfo = {};
+			sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			sourceInfo.imageView = levelViews[0];
+			sourceInfo.sampler = lookupSampler(mipmapSampler);
+
+			VkDescriptorImageInfo levelInfos[MIPMAP_LEVELS];
+			for(uint32_t level = 0; level < MIPMAP_LEVELS; level++)
+			{
+				levelInfos[level].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+				levelInfos[level].imageView = levelViews[1 + (level < count ? level : count - 1)];
+				levelInfos[level].sampler = VK_NULL_HANDLE;
+			}
+
+			VkWriteDescriptorSet sourceDescriptorWrite = {};
+			sourceDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			sourceDescriptorWrite.dstSet = sets[setIndex];
+			sourceDescriptorWrite.dstBinding = 0;
+			sourceDescriptorWrite.dstArrayElement = 0;
+			sourceDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			sourceDescriptorWrite.descriptorCount = 1;
+			sourceDescriptorWrite.pImageInfo = &sourceInfo;
+
+			VkWriteDescriptorSet levelDescriptorWrite = {};
+			levelDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			levelDescriptorWrite.dstSet = sets[setIndex];
+			levelDescriptorWrite.dstBinding = 1;
+			levelDescriptorWrite.dstArrayElement = 0;
+			levelDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			levelDescriptorWrite.descriptorCount = MIPMAP_LEVELS;
+			levelDescriptorWrite.pImageInfo = levelInfos;
+
+			vkUpdateDescriptorSets(device, 2, (VkWriteDescriptorSet[]){sourceDescriptorWrite, levelDescriptorWrite},
+			 0, NULL);
+
+			uint32_t sourceWidth = request->width >> base ? request->width >> base : 1;
+			uint32_t sourceHeight = request->height >> base ? request->height >> base : 1;
+			uint32_t targetWidth = sourceWidth > 1 ? sourceWidth / 2 : 1;
+			uint32_t targetHeight = sourceHeight > 1 ? sourceHeight / 2 : 1;
+
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmapLayout, 0, 1,
+			 &sets[setIndex++], 0, NULL);
+			vkCmdPushConstants(commandBuffer, mipmapLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, 5 * sizeof(uint32_t),
+			 (uint32_t[]){sourceWidth, sourceHeight, count, request->filter, request->srgb});
+			vkCmdDispatch(commandBuffer, (targetWidth + MIPMAP_GROUP - 1) / MIPMAP_GROUP,
+			 (targetHeight + MIPMAP_GROUP - 1) / MIPMAP_GROUP, request->layers);
+		}
+	}
+
+	for(uint32_t requestIndex = 0; requestIndex < mipmapCount; requestIndex++)
+	{
+		imageBarriers[requestIndex].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		imageBarriers[requestIndex].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageBarriers[requestIndex].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		imageBarriers[requestIndex].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	if(!compute)
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, mipmapCount, imageBarriers);
+
+	// On the compute queue the levels are released to the graphics family, and the frame waiting on this work
+	// records the matching acquire
+	else
+	{
+		for(uint32_t requestIndex = 0; requestIndex < mipmapCount; requestIndex++)
+		{
+			if(computeIndex != graphicsIndex)
+			{
+				imageBarriers[requestIndex].srcQueueFamilyIndex = computeIndex;
+				imageBarriers[requestIndex].dstQueueFamilyIndex = graphicsIndex;
+				imageBarriers[requestIndex].srcAccessMask = 0;
+				deferComputeAcquire(imageBarriers[requestIndex]);
+				imageBarriers[requestIndex].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			}
+			imageBarriers[requestIndex].dstAccessMask = 0;
+		}
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, mipmapCount, imageBarriers);
+		computeDispatches += setCount;
+	}
+
+	// The dispatches have only been recorded, so the level views and sets live until their work retires
+	for(uint32_t viewIndex = 0; viewIndex < viewCount; viewIndex++)
+		compute ? deferComputeView(views[viewIndex]) : deferUploadView(views[viewIndex]);
+	compute ? deferComputePool(pool) : deferUploadPool(pool);
+
+	printlog(1, "Generate Mipmaps: %u Textures, %u Dispatches, %u Barriers%s", mipmapCount, setCount, barriers + 2,
+	 compute ? ", Compute Stage" : "");
+
+	freeHost(imageBarriers);
+	freeHost(firstViews);
+	freeHost(views);
+	freeHost(sets);
+	mipmapCount = 0;
+}
+
+void generateMipmaps()
+{
+	if(mipmapCount)
+		recordMipmaps(beginUpload(), 0);
+}
+
+void dispatchMipmaps()
+{
+	if(mipmapCount)
+		recordMipmaps(beginCompute(), 1);
+}
+
+void benchmarkMipmaps()
+{
+	uint32_t size = 4096, levels = 13, iterations = 8;
+	const char *names[] = {"Blit", "Box", "Kaiser", "Box sRGB"};
+	double times[4] = {};
+
+	VkImage image;
+	Allocation memory;
+	createImage(size, size, levels, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+	 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+	 VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &image, &memory);
+
+	for(uint32_t iteration = 0; iteration < iterations; iteration++)
+	{
+		for(uint32_t method = 0; method < 4; method++)
+		{
+			transitionImageLayout(image, levels, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			waitUpload(submitUpload());
+			double start = measureTime();
+
+			if(method == 0)
+				blitMipmaps(image, size, size, levels, 1, VK_FORMAT_R8G8B8A8_UNORM);
+			else
+			{
+				queueMipmaps(image, VK_FORMAT_R8G8B8A8_UNORM, size, size, levels, 1,
+				 method == 2 ? MIPMAP_KAISER : MIPMAP_BOX, method == 3);
+				generateMipmaps();
+			}
+
+			waitUpload(submitUpload());
+			times[method] += measureTime() - start;
+		}
+	}
+
+	vkDestroyImage(device, image, NULL);
+	freeMemory(&memory);
+
+	for(uint32_t method = 0; method < 4; method++)
+		printlog(1, "Mipmap Benchmark: %s %.3f ms (%u x %u, %u Levels)", names[method],
+		 1000.0 * times[method] / iterations, size, size, levels);
+}
+
+void benchmarkReducedJpeg()
+{
+	const char *path = "textures/chalet.jpg";
+	uint32_t iterations = 4;
+
+	for(uint32_t reduction = 1; reduction <= RESIDENCY_REDUCTION; reduction++)
+	{
+		uint32_t scale = 1 << reduction;
+		int width, height, channels, reducedWidth, reducedHeight;
+		uint8_t *boxed = NULL, *reduced = NULL;
+		double fullTime = 0.0, reducedTime = 0.0;
+
+		for(uint32_t iteration = 0; iteration < iterations; iteration++)
+		{
+			freeHost(boxed);
+			freeHost(reduced);
+
+			double start = measureTime();
+			stbi_uc *pixels = stbi_load(path, &width, &height, &channels, STBI_rgb_alpha);
+			printlog(pixels != NULL, NULL);
+
+			uint32_t boxedWidth = (width + scale - 1) / scale, boxedHeight = (height + scale - 1) / scale;
+			boxed = allocateHost(HOST_TEXTURE, (size_t)boxedWidth * boxedHeight * 4);
+
+			for(uint32_t y = 0; y < boxedHeight; y++)
+			{
+				for(uint32_t x = 0; x < boxedWidth; x++)
+				{
+					for(uint32_t channel = 0; channel < 4; channel++)
+					{
+						uint32_t sum = 0, count = 0;
+						for(uint32_t row = y * scale; row < (y + 1) * scale && row < (uint32_t)height; row++)
+							for(uint32_t column = x * scale; column < (x + 1) * scale && column < (uint32_t)width; column++, count++)
+								sum += pixels[((size_t)row * width + column) * 4 + channel];
+						boxed[((size_t)y * boxedWidth + x) * 4 + channel] = (sum + count / 2) / count;
+					}
+				}
+			}
+
+			stbi_image_free(pixels);
+			fullTime += measureTime() - start;
+
+			start = measureTime();
+			reduced = loadReducedJpeg(path, scale, &reducedWidth, &reducedHeight);
+			reducedTime += measureTime() - start;
+
+			if(!reduced)
+				break;
+		}
+
+		if(!reduced)
+		{
+			printlog(1, "JPEG Benchmark: 1/%u Unsupported, Full Decode Used", scale);
+			freeHost(boxed);
+			continue;
+		}
+
+		double squared = 0.0;
+		uint32_t maximum = 0;
+		size_t size = (size_t)reducedWidth * reducedHeight * 4;
+
+		for(size_t index = 0; index < size; index++)
+		{
+			uint32_t difference = abs(reduced[index] - boxed[index]);
+			squared += difference * difference;
+			maximum = difference > maximum ? difference : maximum;
+		}
+
+		printlog(1, "JPEG Benchmark: 1/%u Full %.3f ms, Reduced %.3f ms (%u x %u), %.2f dB PSNR, %u Max Error",
+		 scale, 1000.0 * fullTime / iterations, 1000.0 * reducedTime / iterations, reducedWidth, reducedHeight,
+		 squared ? 10.0 * log10(255.0 * 255.0 * size / squared) : INFINITY, maximum);
+
+		freeHost(boxed);
+		freeHost(reduced);
+	}
+}
+
+void createTextureImage()
+{
+	int textureWidth, textureHeight, textureChannels;
+	stbi_uc *pixels = stbi_load("textures/chalet.jpg",
+	 &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha);
+	printlog(pixels != NULL, NULL);
+	mipLevels = floor(log2f(fmaxf(textureWidth, textureHeight))) + 1;
+
+	VkDeviceSize imageSize = textureWidth * textureHeight * 4;
+
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	memcpy(stageUpload(imageSize, &stagingBuffer, &stagingOffset), pixels, imageSize);
+	stbi_image_free(pixels);
+
+	textureHandle = createTextureHandle(textureWidth, textureHeight, mipLevels, 1, VK_FORMAT_R8G8B8A8_UNORM,
+	 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+	 VK_IMAGE_USAGE_SAMPLED_BIT);
+	uint32_t slot = lookupHandle(&textureTable, textureHandle);
+	copyBufferToImage(stagingBuffer, stagingOffset, textureImages[slot], textureWidth, textureHeight, mipLevels, 1,
+	 graphicsIndex);
+	acquireImage(beginUpload(), textureImages[slot], mipLevels, 1, graphicsIndex);
+	queueMipmaps(textureImages[slot], VK_FORMAT_R8G8B8A8_UNORM, textureWidth, textureHeight, mipLevels, 1,
+	 MIPMAP_KAISER, 1);
+
+	textureViews[slot] = createImageView(textureImages[slot], mipLevels, VK_FORMAT_R8G8B8A8_UNORM,
+	 VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+void createTextureSampler()
+{
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.anisotropyEnable = VK_TRUE;
+	samplerInfo.maxAnisotropy = 16;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = (float)mipLevels;
+
+	printlog(vkCreateSampler(device, &samplerInfo, NULL,
+	 &samplerObjects[acquireSlot(&samplerTable, &textureSampler)]) == VK_SUCCESS, "Create Texture Sampler");
+}
+
+void extractVirtualPage(uint32_t page, uint8_t *pixels)
+{
+	uint32_t level = 0;
+	while(page >= virtualOffsets[level + 1])
+		level++;
+
+	uint32_t count = virtualPages >> level, size = virtualWidth >> level;
+	uint32_t pageX = (page - virtualOffsets[level]) % count, pageY = (page - virtualOffsets[level]) / count;
+	uint32_t *source = (uint32_t*)virtualSources[level], *target = (uint32_t*)pixels;
+
+	for(uint32_t y = 0; y < VIRTUAL_SLOT; y++)
+	{
+		uint32_t sourceY = (pageY * VIRTUAL_PAGE + y + size - VIRTUAL_BORDER) % size;
+		for(uint32_t x = 0; x < VIRTUAL_SLOT; x++)
+			target[y * VIRTUAL_SLOT + x] =
+			 source[sourceY * size + (pageX * VIRTUAL_PAGE + x + size - VIRTUAL_BORDER) % size];
+	}
+}
+
+void *streamVirtualPages(void *argument)
+{
+	(void)argument;
+
+	pthread_mutex_lock(&virtualMutex);
+	while(virtualRunning)
+	{
+		if(requestHead == requestTail)
+		{
+			pthread_cond_wait(&virtualSignal, &virtualMutex);
+			continue;
+		}
+
+		uint32_t page = virtualRequests[requestHead++ % VIRTUAL_QUEUE];
+		pthread_mutex_unlock(&virtualMutex);
+
+		uint8_t *pixels = allocateHost(HOST_TEXTURE, VIRTUAL_SLOT * VIRTUAL_SLOT * 4);
+		extractVirtualPage(page, pixels);
+
+		pthread_mutex_lock(&virtualMutex);
+		virtualTiles[tileTail++ % VIRTUAL_QUEUE] = (VirtualTile){page, pixels};
+	}
+	pthread_mutex_unlock(&virtualMutex);
+
+	return NULL;
+}
+
+void unlinkVirtualSlot(int32_t slot)
+{
+	if(virtualSlots[slot].prev != -1)
+		virtualSlots[virtualSlots[slot].prev].next = virtualSlots[slot].next;
+	else
+		virtualHead = virtualSlots[slot].next;
+
+	if(virtualSlots[slot].next != -1)
+		virtualSlots[virtualSlots[slot].next].prev = virtualSlots[slot].prev;
+	else
+		virtualTail = virtualSlots[slot].prev;
+}
+
+void touchVirtualSlot(int32_t slot)
+{
+	if(virtualSlots[slot].page == (int32_t)virtualPageCount - 1 || virtualHead == slot)
+		return;
+
+	unlinkVirtualSlot(slot);
+	virtualSlots[slot].prev = -1;
+	virtualSlots[slot].next = virtualHead;
+	if(virtualHead != -1)
+		virtualSlots[virtualHead].prev = slot;
+	else
+		virtualTail = slot;
+	virtualHead = slot;
+}
+
+int32_t allocateVirtualSlot(uint32_t page)
+{
+	int32_t slot = -1;
+
+	if(virtualUnused < VIRTUAL_SLOTS * VIRTUAL_SLOTS)
+		slot = virtualUnused++;
+
+	else if(virtualTail != -1 && virtualTable[virtualSlots[virtualTail].page].used != frameCount)
+	{
+		slot = virtualTail;
+		unlinkVirtualSlot(slot);
+		virtualTable[virtualSlots[slot].page].slot = -1;
+		virtualEvictions++;
+	}
+
+	if(slot == -1)
+		return -1;
+
+	virtualSlots[slot].page = page;
+	virtualSlots[slot].prev = -1;
+	virtualSlots[slot].next = -1;
+	virtualTable[page].slot = slot;
+
+	if(page != virtualPageCount - 1)
+	{
+		virtualSlots[slot].next = virtualHead;
+		if(virtualHead != -1)
+			virtualSlots[virtualHead].prev = slot;
+		else
+			virtualTail = slot;
+		virtualHead = slot;
+	}
+
+	return slot;
+}
+
+void requestVirtualPages(uint32_t frame)
+{
+	uint32_t requested = 0;
+
+	for(uint32_t cell = 0; cell < feedbackExtents[frame].width * feedbackExtents[frame].height; cell++)
+	{
+		uint32_t value = feedbackData[frame][cell];
+		if(!value--)
+			continue;
+
+		uint32_t level = value >> 24, pageY = (value >> 12) & 0xFFF, pageX = value & 0xFFF;
+		if(level >= virtualLevels || pageX >= virtualPages >> level || pageY >= virtualPages >> level)
+			continue;
+
+		uint32_t page = virtualOffsets[level] + pageY * (virtualPages >> level) + pageX;
+		if(virtualTable[page].used == frameCount)
+			continue;
+
+		virtualTable[page].used = frameCount;
+		if(virtualTable[page].slot != -1)
+			virtualHits++;
+		else
+		{
+			virtualMisses++;
+			if(!virtualTable[page].pending && virtualPending < VIRTUAL_QUEUE)
+			{
+				virtualTable[page].pending = 1;
+				virtualRequests[requestTail % VIRTUAL_QUEUE] = page;
+				virtualPending++;
+				requested++;
+
+				pthread_mutex_lock(&virtualMutex);
+				requestTail++;
+				pthread_mutex_unlock(&virtualMutex);
+			}
+		}
+
+		for(uint32_t parent = level; parent < virtualLevels; parent++)
+		{
+			page = virtualOffsets[parent] + (pageY >> (parent - level)) * (virtualPages >> parent) +
+			 (pageX >> (parent - level));
+			if(virtualTable[page].slot != -1)
+				touchVirtualSlot(virtualTable[page].slot);
+		}
+	}
+
+	if(requested)
+		pthread_cond_signal(&virtualSignal);
+}
+
+void buildVirtualEntries()
+{
+	for(int32_t level = virtualLevels - 1; level >= 0; level--)
+	{
+		uint32_t count = virtualPages >> level;
+
+		for(uint32_t pageY = 0; pageY < count; pageY++)
+		{
+			for(uint32_t pageX = 0; pageX < count; pageX++)
+			{
+				uint32_t page = virtualOffsets[level] + pageY * count + pageX;
+				int32_t slot = virtualTable[page].slot;
+
+				if(slot != -1)
+					virtualEntries[page] = (slot % VIRTUAL_SLOTS) | (slot / VIRTUAL_SLOTS) << 8 | level << 16 | 255u << 24;
+				else if(level < (int32_t)virtualLevels - 1)
+					virtualEntries[page] = virtualEntries[virtualOffsets[level + 1] +
+					 (pageY / 2) * (count / 2) + pageX / 2];
+				else
+					virtualEntries[page] = 0;
+			}
+		}
+	}
+}
+
+uint32_t uploadVirtualPages(VkCommandBuffer commandBuffer, uint32_t frame, VkImageLayout layout)
+{
+	VkDeviceSize tileSize = VIRTUAL_SLOT * VIRTUAL_SLOT * 4;
+	VkDeviceSize frameOffset = frame * (VIRTUAL_UPLOADS * tileSize + virtualPageCount * sizeof(uint32_t));
+	VkBufferImageCopy tileRegions[VIRTUAL_UPLOADS], pageRegions[VIRTUAL_LEVELS];
+	uint32_t tileCount = 0;
+
+	pthread_mutex_lock(&virtualMutex);
+	while(tileCount < VIRTUAL_UPLOADS && tileHead != tileTail)
+	{
+		VirtualTile tile = virtualTiles[tileHead % VIRTUAL_QUEUE];
+		int32_t slot = allocateVirtualSlot(tile.page);
+		if(slot == -1)
+			break;
+
+		tileHead++;
+		virtualPending--;
+		virtualTable[tile.page].pending = 0;
+		memcpy(virtualMapped + frameOffset + tileCount * tileSize, tile.pixels, tileSize);
+		freeHost(tile.pixels);
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = frameOffset + tileCount * tileSize;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = (VkOffset3D){(slot % VIRTUAL_SLOTS) * VIRTUAL_SLOT, (slot / VIRTUAL_SLOTS) * VIRTUAL_SLOT, 0};
+		region.imageExtent = (VkExtent3D){VIRTUAL_SLOT, VIRTUAL_SLOT, 1};
+		tileRegions[tileCount++] = region;
+	}
+	pthread_mutex_unlock(&virtualMutex);
+
+	if(!tileCount)
+		return 0;
+
+	VkDeviceSize pageOffset = frameOffset + VIRTUAL_UPLOADS * tileSize;
+	buildVirtualEntries();
+	memcpy(virtualMapped + pageOffset, virtualEntries, virtualPageCount * sizeof(uint32_t));
+
+	for(uint32_t level = 0; level < virtualLevels; level++)
+	{
+		VkBufferImageCopy region = {};
+		region.bufferOffset = pageOffset + virtualOffsets[level] * sizeof(uint32_t);
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = level;
+		region.imageSubresource.baseArrayLayer = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = (VkOffset3D){0, 0, 0};
+		region.imageExtent = (VkExtent3D){virtualPages >> level, virtualPages >> level, 1};
+		pageRegions[level] = region;
+	}
+
+	VkImage atlasImage = lookupImage(atlasHandle), pageImage = lookupImage(pageHandle);
+	VkImageMemoryBarrier barriers[2] = {};
+	for(uint32_t barrierIndex = 0; barrierIndex < 2; barrierIndex++)
+	{
+		barriers[barrierIndex].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[barrierIndex].image = barrierIndex ? pageImage : atlasImage;
+		barriers[barrierIndex].oldLayout = layout;
+		barriers[barrierIndex].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[barrierIndex].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[barrierIndex].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[barrierIndex].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barriers[barrierIndex].subresourceRange.baseMipLevel = 0;
+		barriers[barrierIndex].subresourceRange.levelCount = barrierIndex ? virtualLevels : 1;
+		barriers[barrierIndex].subresourceRange.baseArrayLayer = 0;
+		barriers[barrierIndex].subresourceRange.layerCount = 1;
+		barriers[barrierIndex].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[barrierIndex].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+	 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 2, barriers);
+	vkCmdCopyBufferToImage(commandBuffer, lookupBuffer(virtualStaging), atlasImage,
+	 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, tileCount, tileRegions);
+	vkCmdCopyBufferToImage(commandBuffer, lookupBuffer(virtualStaging), pageImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	 virtualLevels, pageRegions);
+
+	for(uint32_t barrierIndex = 0; barrierIndex < 2; barrierIndex++)
+	{
+		barriers[barrierIndex].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[barrierIndex].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[barrierIndex].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[barrierIndex].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+	 0, 0, NULL, 0, NULL, 2, barriers);
+
+	virtualUploads += tileCount;
+	virtualBytes += tileCount * tileSize + virtualPageCount * sizeof(uint32_t);
+	return tileCount;
+}
+
+void createVirtualTexture()
+{
+	int textureWidth, textureHeight, textureChannels;
+	virtualSources[0] = stbi_load("textures/chalet.jpg",
+	 &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha);
+	printlog(virtualSources[0] != NULL && textureWidth == textureHeight && textureWidth >= VIRTUAL_PAGE &&
+	 !(textureWidth & (textureWidth - 1)), NULL);
+
+	virtualWidth = textureWidth;
+	virtualPages = virtualWidth / VIRTUAL_PAGE;
+	virtualLevels = log2f(virtualPages) + 1;
+	printlog(virtualLevels <= VIRTUAL_LEVELS, NULL);
+
+	virtualOffsets[0] = 0;
+	for(uint32_t level = 0; level < virtualLevels; level++)
+		virtualOffsets[level + 1] = virtualOffsets[level] + (virtualPages >> level) * (virtualPages >> level);
+	virtualPageCount = virtualOffsets[virtualLevels];
+
+	for(uint32_t level = 1; level < virtualLevels; level++)
+	{
+		uint32_t size = virtualWidth >> level;
+		uint8_t *source = virtualSources[level - 1];
+		virtualSources[level] = allocateHost(HOST_TEXTURE, size * size * 4);
+
+		for(uint32_t y = 0; y < size; y++)
+			for(uint32_t x = 0; x < size; x++)
+				for(uint32_t channel = 0; channel < 4; channel++)
+					virtualSources[level][(y * size + x) * 4 + channel] = (
+					 source[((2 * y) * 2 * size + 2 * x) * 4 + channel] +
+					 source[((2 * y) * 2 * size + 2 * x + 1) * 4 + channel] +
+					 source[((2 * y + 1) * 2 * size + 2 * x) * 4 + channel] +
+					 source[((2 * y + 1) * 2 * size + 2 * x + 1) * 4 + channel] + 2) / 4;
+	}
+
+	virtualTable = allocateHost(HOST_TEXTURE, virtualPageCount * sizeof(VirtualPage));
+	virtualEntries = allocateHostZeroed(HOST_TEXTURE, virtualPageCount, sizeof(uint32_t));
+	for(uint32_t page = 0; page < virtualPageCount; page++)
+		virtualTable[page] = (VirtualPage){-1, UINT32_MAX, 0};
+	virtualHead = virtualTail = -1;
+	virtualUnused = 0;
+
+	atlasHandle = createTextureHandle(VIRTUAL_SLOT * VIRTUAL_SLOTS, VIRTUAL_SLOT * VIRTUAL_SLOTS, 1, 1,
+	 VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	uint32_t slot = lookupHandle(&textureTable, atlasHandle);
+	textureViews[slot] = createImageView(textureImages[slot], 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
+
+	pageHandle = createTextureHandle(virtualPages, virtualPages, virtualLevels, 1, VK_FORMAT_R8G8B8A8_UINT,
+	 VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+	slot = lookupHandle(&textureTable, pageHandle);
+	textureViews[slot] = createImageView(textureImages[slot], virtualLevels, VK_FORMAT_R8G8B8A8_UINT,
+	 VK_IMAGE_ASPECT_COLOR_BIT);
+
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.anisotropyEnable = VK_FALSE;
+	samplerInfo.maxAnisotropy = 1;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = 0.0f;
+	printlog(vkCreateSampler(device, &samplerInfo, NULL,
+	 &samplerObjects[acquireSlot(&samplerTable, &atlasSampler)]) == VK_SUCCESS, NULL);
+
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.maxLod = (float)virtualLevels;
+	printlog(vkCreateSampler(device, &samplerInfo, NULL,
+	 &samplerObjects[acquireSlot(&samplerTable, &pageSampler)]) == VK_SUCCESS,
+	 "Create Virtual Texture: %u x %u, %u Pages in %u Levels, %u Physical Slots",
+	 virtualWidth, virtualWidth, virtualPageCount, virtualLevels, VIRTUAL_SLOTS * VIRTUAL_SLOTS);
+}
+
+void createVirtualFrames()
+{
+	VkDeviceSize frameSize = VIRTUAL_UPLOADS * VIRTUAL_SLOT * VIRTUAL_SLOT * 4 + virtualPageCount * sizeof(uint32_t);
+	virtualStaging = createBufferHandle(framebufferLimit * frameSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	virtualMapped = lookupBufferMemory(virtualStaging)->mapped;
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = graphicsIndex;
+	printlog(vkCreateCommandPool(device, &poolInfo, NULL, &virtualPool) == VK_SUCCESS, NULL);
+
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.commandPool = virtualPool;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = framebufferLimit;
+
+	virtualCommands = allocateHost(HOST_TEXTURE, framebufferLimit * sizeof(VkCommandBuffer));
+	printlog(vkAllocateCommandBuffers(device, &allocateInfo, virtualCommands) == VK_SUCCESS, NULL);
+
+	virtualTable[virtualPageCount - 1].pending = 1;
+	virtualTiles[tileTail].page = virtualPageCount - 1;
+	virtualTiles[tileTail].pixels = allocateHost(HOST_TEXTURE, VIRTUAL_SLOT * VIRTUAL_SLOT * 4);
+	extractVirtualPage(virtualPageCount - 1, virtualTiles[tileTail++].pixels);
+	virtualPending++;
+
+	transitionImageLayout(lookupImage(atlasHandle), 1, 1, VK_FORMAT_R8G8B8A8_UNORM,
+	 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	transitionImageLayout(lookupImage(pageHandle), virtualLevels, 1, VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+	uploadVirtualPages(beginUpload(), 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+	virtualRunning = 1;
+	pthread_mutex_init(&virtualMutex, NULL);
+	pthread_cond_init(&virtualSignal, NULL);
+	printlog(!pthread_create(&virtualThread, NULL, streamVirtualPages, NULL),
+	 "Start Virtual Texture Streaming: %u Uploads per Frame", VIRTUAL_UPLOADS);
+}
+
+void reportVirtualTexture(double elapsed)
+{
+	printlog(1, "Virtual Texture: %lu Hits, %lu Misses, %.2f%% Hit Rate", virtualHits, virtualMisses,
+	 virtualHits + virtualMisses ? 100.0 * virtualHits / (virtualHits + virtualMisses) : 100.0);
+	printlog(1, "Virtual Texture: %lu Pages Uploaded, %lu Evicted, %.3f MB at %.3f MB/s", virtualUploads,
+	 virtualEvictions, virtualBytes / 1048576.0, elapsed > 0 ? virtualBytes / 1048576.0 / elapsed : 0.0);
+}
+
+void cleanupVirtualTexture()
+{
+	pthread_mutex_lock(&virtualMutex);
+	virtualRunning = 0;
+	pthread_cond_signal(&virtualSignal);
+	pthread_mutex_unlock(&virtualMutex);
+	pthread_join(virtualThread, NULL);
+	pthread_cond_destroy(&virtualSignal);
+	pthread_mutex_destroy(&virtualMutex);
+
+	while(tileHead != tileTail)
+		freeHost(virtualTiles[tileHead++ % VIRTUAL_QUEUE].pixels);
+
+	vkFreeCommandBuffers(device, virtualPool, framebufferLimit, virtualCommands);
+	vkDestroyCommandPool(device, virtualPool, NULL);
+	destroyHandle(&bufferTable, virtualStaging);
+	destroyHandle(&samplerTable, pageSampler);
+	destroyHandle(&samplerTable, atlasSampler);
+	destroyHandle(&textureTable, pageHandle);
+	destroyHandle(&textureTable, atlasHandle);
+
+	stbi_image_free(virtualSources[0]);
+	for(uint32_t level = 1; level < virtualLevels; level++)
+		freeHost(virtualSources[level]);
+	freeHost(virtualTable);
+	freeHost(virtualEntries);
+	freeHost(virtualCommands);
+}
+
+int32_t registerPackedTexture(const char *path)
+{
+	for(uint32_t entry = 0; entry < packedCount; entry++)
+		if(!strcmp(packedTextures[entry].path, path))
+			return entry;
+
+	struct stat status;
+	int textureWidth, textureHeight, textureChannels;
+
+	if(packedCount == ATLAS_ENTRIES || strlen(path) >= sizeof(packedTextures[0].path) || stat(path, &status) ||
+	 !stbi_info(path, &textureWidth, &textureHeight, &textureChannels) ||
+	 textureWidth > ATLAS_LIMIT || textureHeight > ATLAS_LIMIT)
+		return -1;
+
+	PackedTexture *texture = &packedTextures[packedCount];
+	memset(texture, 0, sizeof(PackedTexture));
+	strcpy(texture->path, path);
+	texture->modified = status.st_mtime;
+	texture->width = textureWidth;
+	texture->height = textureHeight;
+	texture->layer = UINT32_MAX;
+
+	return packedCount++;
+}
+
+int comparePackedTextures(const void *first, const void *second)
+{
+	PackedTexture *a = &packedTextures[*(const uint32_t*)first], *b = &packedTextures[*(const uint32_t*)second];
+	return a->height != b->height ? (int)b->height - (int)a->height : (int)b->width - (int)a->width;
+}
+
+void placePackedTextures()
+{
+	uint32_t *order = allocateHost(HOST_TEXTURE, packedCount * sizeof(uint32_t));
+	for(uint32_t entry = 0; entry < packedCount; entry++)
+		order[entry] = entry;
+	qsort(order, packedCount, sizeof(uint32_t), comparePackedTextures);
+
+	uint32_t x = 0, y = 0, shelf = 0;
+	packedLayers = 0;
+
+	for(uint32_t entry = 0; entry < packedCount; entry++)
+	{
+		PackedTexture *texture = &packedTextures[order[entry]];
+		uint32_t slotWidth = (texture->width + 3 * ATLAS_PADDING - 1) & ~(ATLAS_PADDING - 1);
+		uint32_t slotHeight = (texture->height + 3 * ATLAS_PADDING - 1) & ~(ATLAS_PADDING - 1);
+
+		if(x + slotWidth > ATLAS_SIZE)
+		{
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+
+		if(!packedLayers || y + slotHeight > ATLAS_SIZE)
+		{
+			if(packedLayers == ATLAS_PAGES)
+				break;
+			packedLayers++;
+			x = y = shelf = 0;
+		}
+
+		texture->layer = packedLayers - 1;
+		texture->x = x;
+		texture->y = y;
+		x += slotWidth;
+		shelf = slotHeight > shelf ? slotHeight : shelf;
+	}
+
+	freeHost(order);
+}
+
+void drawPackedTexture(PackedTexture *texture)
+{
+	int textureWidth, textureHeight, textureChannels;
+	stbi_uc *pixels = stbi_load(texture->path, &textureWidth, &textureHeight, &textureChannels, STBI_rgb_alpha);
+	printlog(pixels != NULL && textureWidth == (int)texture->width && textureHeight == (int)texture->height, NULL);
+
+	uint8_t *page = packedPixels + (size_t)texture->layer * ATLAS_SIZE * ATLAS_SIZE * 4;
+
+	for(int32_t row = -ATLAS_PADDING; row < textureHeight + ATLAS_PADDING; row++)
+	{
+		int32_t sourceRow = row < 0 ? 0 : row < textureHeight ? row : textureHeight - 1;
+
+		for(int32_t column = -ATLAS_PADDING; column < textureWidth + ATLAS_PADDING; column++)
+		{
+			int32_t sourceColumn = column < 0 ? 0 : column < textureWidth ? column : textureWidth - 1;
+			memcpy(page + ((texture->y + ATLAS_PADDING + row) * ATLAS_SIZE + texture->x + ATLAS_PADDING + column) * 4,
+			 pixels + (sourceRow * textureWidth + sourceColumn) * 4, 4);
+		}
+	}
+
+	stbi_image_free(pixels);
+}
+
+int loadPackedCache()
+{
+	FILE *file = fopen(ATLAS_CACHE, "rb");
+	if(!file)
+		return 0;
+
+	uint32_t header[6];
+	PackedTexture *cached = allocateHost(HOST_TEXTURE, (packedCount ? packedCount : 1) * sizeof(PackedTexture));
+	int valid = fread(header, sizeof(header), 1, file) == 1 && header[0] == ATLAS_MAGIC &&
+	 header[1] == ATLAS_VERSION && header[2] == ATLAS_SIZE && header[3] == ATLAS_PADDING &&
+	 header[4] == packedCount && header[5] <= ATLAS_PAGES &&
+	 fread(cached, sizeof(PackedTexture), packedCount, file) == packedCount;
+
+	for(uint32_t entry = 0; valid && entry < packedCount; entry++)
+		valid = !strcmp(cached[entry].path, packedTextures[entry].path) &&
+		 cached[entry].modified == packedTextures[entry].modified &&
+		 cached[entry].width == packedTextures[entry].width && cached[entry].height == packedTextures[entry].height;
+
+	if(valid)
+	{
+		packedLayers = header[5];
+		packedPixels = allocateHost(HOST_TEXTURE, (packedLayers ? packedLayers : 1) * ATLAS_SIZE * ATLAS_SIZE * 4);
+		valid = fread(packedPixels, ATLAS_SIZE * ATLAS_SIZE * 4, packedLayers, file) == packedLayers;
+
+		if(valid)
+			memcpy(packedTextures, cached, packedCount * sizeof(PackedTexture));
+		else
+		{
+			freeHost(packedPixels);
+			packedPixels = NULL;
+		}
+	}
+
+	freeHost(cached);
+	fclose(file);
+	return valid;
+}
+
+void storePackedCache()
+{
+	FILE *file = fopen(ATLAS_CACHE ".tmp", "wb");
+	if(!file)
+		return;
+
+	uint32_t header[6] = {ATLAS_MAGIC, ATLAS_VERSION, ATLAS_SIZE, ATLAS_PADDING, packedCount, packedLayers};
+	int written = fwrite(header, sizeof(header), 1, file) == 1 &&
+	 fwrite(packedTextures, sizeof(PackedTexture), packedCount, file) == packedCount &&
+	 fwrite(packedPixels, ATLAS_SIZE * ATLAS_SIZE * 4, packedLayers, file) == packedLayers;
+
+	if(fclose(file) || !written || rename(ATLAS_CACHE ".tmp", ATLAS_CACHE))
+		remove(ATLAS_CACHE ".tmp");
+}
+
+void packTextures()
+{
+	double start = measureTime();
+	packedCached = packedCount && loadPackedCache();
+
+	if(!packedCached)
+	{
+		placePackedTextures();
+		packedPixels = allocateHostZeroed(HOST_TEXTURE, packedLayers ? packedLayers : 1, ATLAS_SIZE * ATLAS_SIZE * 4);
+
+		for(uint32_t entry = 0; entry < packedCount; entry++)
+			if(packedTextures[entry].layer != UINT32_MAX)
+				drawPackedTexture(&packedTextures[entry]);
+
+		if(packedCount)
+			storePackedCache();
+	}
+
+	uint32_t packedMeshes = 0, packedEntries = 0;
+
+	for(uint32_t entry = 0; entry < packedCount; entry++)
+		packedEntries += packedTextures[entry].layer != UINT32_MAX;
+
+	for(uint32_t meshIndex = 0; meshIndex < meshTable.count; meshIndex++)
+	{
+		Mesh *mesh = &meshes[meshIndex];
+		if(mesh->texture < 0 || packedTextures[mesh->texture].layer == UINT32_MAX)
+			continue;
+
+		PackedTexture *texture = &packedTextures[mesh->texture];
+		mesh->mode = 2;
+		mesh->layer = texture->layer;
+		packedMeshes++;
+
+		for(uint32_t vertexIndex = mesh->firstVertex; vertexIndex < mesh->firstVertex + mesh->vertexCount;
+		 vertexIndex++)
+		{
+			// The loader stores the negated OBJ v, so 1 + v maps it back into the slot with v = 0 at the bottom
+			float *coordinate = vertices[vertexIndex].tex;
+			float u = fminf(fmaxf(coordinate[0], 0.0f), 1.0f);
+			float v = fminf(fmaxf(1.0f + coordinate[1], 0.0f), 1.0f);
+			coordinate[0] = (texture->x + ATLAS_PADDING + u * texture->width) / ATLAS_SIZE;
+			coordinate[1] = (texture->y + ATLAS_PADDING + v * texture->height) / ATLAS_SIZE;
+		}
+	}
+
+	printlog(1, "Pack Textures: %u textures into %u pages, %u meshes, %u allocations saved%s in %.3f seconds",
+	 packedEntries, packedLayers, packedMeshes, packedEntries ? packedEntries - 1 : 0,
+	 packedCached ? " from cache" : "", measureTime() - start);
+}
+
+void createPackedTexture()
+{
+	uint32_t size = packedLayers ? ATLAS_SIZE : 1;
+	uint32_t layers = packedLayers ? packedLayers : 1;
+	uint32_t levels = packedLayers ? ATLAS_LEVELS : 1;
+
+	VkDeviceSize imageSize = (VkDeviceSize)size * size * 4 * layers;
+
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	memcpy(stageUpload(imageSize, &stagingBuffer, &stagingOffset), packedPixels, imageSize);
+
+	packedHandle = createTextureHandle(size, size, levels, layers, VK_FORMAT_R8G8B8A8_UNORM,
+	 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+	 VK_IMAGE_USAGE_SAMPLED_BIT);
+	uint32_t slot = lookupHandle(&textureTable, packedHandle);
+	copyBufferToImage(stagingBuffer, stagingOffset, textureImages[slot], size, size, levels, layers, graphicsIndex);
+	acquireImage(beginUpload(), textureImages[slot], levels, layers, graphicsIndex);
+	queueMipmaps(textureImages[slot], VK_FORMAT_R8G8B8A8_UNORM, size, size, levels, layers, MIPMAP_BOX, 1);
+
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+	viewInfo.image = textureImages[slot];
+	viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = levels;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.layerCount = layers;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+
+	printlog(vkCreateImageView(device, &viewInfo, NULL, &textureViews[slot]) == VK_SUCCESS,
+	 "Create Packed Texture: %u x %u x %u", size, size, layers);
+
+	// Slots must not wrap into their neighbours, and the padding only covers a few texels at the last level
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	samplerInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerInfo.compareEnable = VK_FALSE;
+	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
+	samplerInfo.anisotropyEnable = VK_TRUE;
+	samplerInfo.maxAnisotropy = 2;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.mipLodBias = 0.0f;
+	samplerInfo.minLod = 0.0f;
+	samplerInfo.maxLod = (float)(levels - 1);
+
+	printlog(vkCreateSampler(device, &samplerInfo, NULL,
+	 &samplerObjects[acquireSlot(&samplerTable, &packedSampler)]) == VK_SUCCESS, NULL);
+}
+
+uint16_t hashVertex(Vertex vertex)
+{
+	uint16_t hash = 0;
+	for(uint16_t seed = 0; seed < 16; seed++)
+		hash ^= (vertex.data[seed] << seed) | (vertex.data[seed] >> (16 - seed));
+	return hash;
+}
+
+int compareVertex(Vertex v1, Vertex v2)
+{
+	return v1.pos[0] == v2.pos[0] && v1.pos[1] == v2.pos[1] && v1.pos[2] == v2.pos[2]
+	 && v1.col[0] == v2.col[0] && v1.col[1] == v2.col[1] && v1.col[2] == v2.col[2] &&
+	 v1.tex[0] == v2.tex[0] && v1.tex[1] == v2.tex[1];
+}
+
+void loadObject(const char *model, float *origin)
+{
+	int file = open(model, O_RDONLY);
+	size_t size = lseek(file, 0, SEEK_END);
+	lseek(file, 0, SEEK_SET);
+	void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+
+	size_t shapeCount;
+	size_t materialCount;
+	tinyobj_attrib_t attributes;
+	tinyobj_shape_t* shapes;
+	tinyobj_material_t* materials;
+
+	printlog(tinyobj_parse_obj(&attributes, &shapes, &shapeCount, &materials, &materialCount, data, size,
+	 TINYOBJ_FLAG_TRIANGULATE) == TINYOBJ_SUCCESS, "Read Object File: %lu bytes", size);
+	munmap(data, size);
+
+	const char *separator = strrchr(model, '/');
+	int directoryLength = separator ? separator - model + 1 : 0;
+	int32_t *materialTextures = allocateHost(HOST_GEOMETRY, (materialCount + 1) * sizeof(int32_t));
+
+	for(size_t material = 0; material <= materialCount; material++)
+	{
+		materialTextures[material] = -1;
+
+		if(material < materialCount && materials[material].diffuse_texname && *materials[material].diffuse_texname)
+		{
+			char path[256];
+			snprintf(path, sizeof(path), "%.*s%s", directoryLength, model, materials[material].diffuse_texname);
+			materialTextures[material] = registerPackedTexture(path);
+		}
+	}
+
+	uint32_t *groups = allocateHost(HOST_GEOMETRY, attributes.num_faces * sizeof(uint32_t));
+	uint32_t *order = allocateHost(HOST_GEOMETRY, attributes.num_faces * sizeof(uint32_t));
+	uint32_t *offsets = allocateHostZeroed(HOST_GEOMETRY, materialCount + 2, sizeof(uint32_t));
+	uint32_t *cursors = allocateHost(HOST_GEOMETRY, (materialCount + 1) * sizeof(uint32_t));
+
+	for(uint32_t index = 0; index < attributes.num_faces; index++)
+	{
+		int material = attributes.material_ids[index / 3];
+		groups[index] = material >= 0 && (size_t)material < materialCount ? (uint32_t)material : materialCount;
+		offsets[groups[index] + 1]++;
+	}
+
+	for(size_t group = 0; group <= materialCount; group++)
+		cursors[group] = offsets[group + 1] += offsets[group];
+	for(uint32_t index = attributes.num_faces; index > 0; index--)
+		order[--cursors[groups[index - 1]]] = index - 1;
+
+	uint32_t uniqueCount = 0;
+
+	for(size_t group = 0; group <= materialCount; group++)
+	{
+		if(offsets[group] == offsets[group + 1])
+			continue;
+
+		uint32_t firstVertex = vertexCount + uniqueCount;
+		int bounded = 1;
+
+		for(uint32_t position = offsets[group]; position < offsets[group + 1]; position++)
+		{
+			uint32_t index = order[position];
+
+			Vertex vertex = {{{
+					origin[0] + attributes.vertices[3 * attributes.faces[index].v_idx],
+					origin[1] + attributes.vertices[3 * attributes.faces[index].v_idx + 1],
+					origin[2] - attributes.vertices[3 * attributes.faces[index].v_idx + 2]
+				},{1.0f, 1.0f, 1.0f},{
+					 attributes.texcoords[2 * attributes.faces[index].vt_idx],
+					-attributes.texcoords[2 * attributes.faces[index].vt_idx + 1]
+			}}};
+
+			bounded &= vertex.tex[0] >= 0.0f && vertex.tex[0] <= 1.0f && vertex.tex[1] >= -1.0f && vertex.tex[1] <= 0.0f;
+			uint16_t iterator = 0, hash = hashVertex(vertex);
+
+			while(iterator < hashMap[hash].size && (hashMap[hash].indices[iterator] < firstVertex ||
+			 !compareVertex(vertex, *hashMap[hash].vertices[iterator])))
+				iterator++;
+
+			if(iterator == hashMap[hash].size)
+			{
+				if(!hashMap[hash].limit)
+				{
+					hashMap[hash].limit = 128;
+					hashMap[hash].indices = allocateHost(HOST_GEOMETRY, hashMap[hash].limit * sizeof(uint32_t));
+					hashMap[hash].vertices = allocateHost(HOST_GEOMETRY, hashMap[hash].limit * sizeof(Vertex*));
+				}
+
+				else if(hashMap[hash].size == hashMap[hash].limit)
+				{
+					hashMap[hash].limit *= 2;
+					hashMap[hash].indices = reallocateHost(HOST_GEOMETRY, hashMap[hash].indices, hashMap[hash].limit * sizeof(uint32_t));
+					hashMap[hash].vertices = reallocateHost(HOST_GEOMETRY, hashMap[hash].vertices, hashMap[hash].limit * sizeof(Vertex*));
+				}
+
+				if(vertexCount + uniqueCount == vertexLimit)
+				{
+					vertexLimit *= 2;
+					vertices = reallocateHost(HOST_GEOMETRY, vertices, vertexLimit * vertexSize);
+				}
+
+				hashMap[hash].indices[iterator] = vertexCount + uniqueCount;
+				indices[indexCount + position] = vertexCount + uniqueCount - firstVertex;
+				vertices[vertexCount + uniqueCount] = vertex;
+				hashMap[hash].vertices[iterator] = &vertices[vertexCount + uniqueCount];
+				uniqueCount++;
+				hashMap[hash].size++;
+			}
+
+			else
+				indices[indexCount + position] = hashMap[hash].indices[iterator] - firstVertex;
+		}
+
+		Handle mesh = acquireHandle(&meshTable);
+		*lookupMesh(mesh) = (Mesh){indexCount + offsets[group], offsets[group + 1] - offsets[group],
+		 firstVertex, vertexCount + uniqueCount - firstVertex, 0, 0, bounded ? materialTextures[group] : -1,
+		 {origin[0], origin[1], origin[2]}, MESH_PENDING};
+	}
+
+	freeHost(materialTextures);
+	freeHost(groups);
+	freeHost(order);
+	freeHost(offsets);
+	freeHost(cursors);
+
+	vertexCount += uniqueCount;
+	indexCount += attributes.num_faces;
+
+	tinyobj_materials_free(materials, materialCount);
+	tinyobj_shapes_free(shapes, shapeCount);
+	tinyobj_attrib_free(&attributes);
+}
+
+void createObjectModels()
+{
+	vertexCount = 0;
+	vertexLimit = INT_MAX / 1024;
+	vertexSize = sizeof(Vertex);
+	vertices = allocateHost(HOST_GEOMETRY, vertexLimit * vertexSize);
+
+	indexCount = 0;
+	indexLimit = INT_MAX / 256;
+	indexSize = sizeof(uint32_t);
+	indices = allocateHost(HOST_GEOMETRY, indexLimit * indexSize);
+
+	hashMap = allocateHostZeroed(HOST_GEOMETRY, USHRT_MAX + 1, sizeof(Node));
+
+	loadObject("models/chalet.obj", (float[]){-1.0f, -1.0f, 0.0f});
+	loadObject("models/chalet.obj", (float[]){-1.0f, 1.0f, 0.0f});
+	loadObject("models/chalet.obj", (float[]){1.0f, -1.0f, 0.0f});
+	loadObject("models/chalet.obj", (float[]){1.0f, 1.0f, 0.0f});
+
+	vertices = reallocateHost(HOST_GEOMETRY, vertices, vertexCount * vertexSize);
+	indices = reallocateHost(HOST_GEOMETRY, indices, indexCount * indexSize);
+
+	for(uint32_t index = 0; index < USHRT_MAX + 1; index++)
+	{
+		if(hashMap[index].limit)
+		{
+			freeHost(hashMap[index].indices);
+			freeHost(hashMap[index].vertices);
+		}
+	}
+
+	freeHost(hashMap);
+	packTextures();
+}
+
+void createGeometryPool(GeometryPool *pool, uint32_t capacity, VkDeviceSize stride, VkBufferUsageFlags usage)
+{
+	*pool = (GeometryPool){HANDLE_NULL, NULL, stride, capacity, 0, 1, 16,
+	 allocateHost(HOST_GEOMETRY, 16 * sizeof(GeometryRange)), 0, 0, 0, 0.0, 0};
+	pool->ranges[0] = (GeometryRange){0, capacity};
+
+	pool->buffer = createBufferHandle(capacity * stride, VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+	 VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, memoryDirect ? MEMORY_DIRECT : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	pool->mapped = directMemory(pool->buffer);
+}
+
+uint32_t allocateGeometry(GeometryPool *pool, uint32_t count, uint32_t limit)
+{
+	for(uint32_t index = 0; index < pool->rangeCount && pool->ranges[index].offset < limit; index++)
+	{
+		if(pool->ranges[index].count < count)
+			continue;
+
+		uint32_t offset = pool->ranges[index].offset;
+		pool->ranges[index].offset += count;
+		pool->ranges[index].count -= count;
+		pool->used += count;
+
+		if(!pool->ranges[index].count)
+			memmove(&pool->ranges[index], &pool->ranges[index + 1],
+			 (--pool->rangeCount - index) * sizeof(GeometryRange));
+		return offset;
+	}
+
+	return UINT32_MAX;
+}
+
+void releaseGeometry(GeometryPool *pool, uint32_t offset, uint32_t count)
+{
+	uint32_t index = 0;
+	while(index < pool->rangeCount && pool->ranges[index].offset < offset)
+		index++;
+
+	int previous = index && pool->ranges[index - 1].offset + pool->ranges[index - 1].count == offset;
+	int next = index < pool->rangeCount && offset + count == pool->ranges[index].offset;
+	pool->used -= count;
+
+	if(previous && next)
+	{
+		pool->ranges[index - 1].count += count + pool->ranges[index].count;
+		memmove(&pool->ranges[index], &pool->ranges[index + 1], (--pool->rangeCount - index) * sizeof(GeometryRange));
+	}
+
+	else if(previous)
+		pool->ranges[index - 1].count += count;
+
+	else if(next)
+	{
+		pool->ranges[index].offset = offset;
+		pool->ranges[index].count += count;
+	}
+
+	else
+	{
+		if(pool->rangeCount == pool->rangeLimit)
+			pool->ranges = reallocateHost(HOST_GEOMETRY, pool->ranges, (pool->rangeLimit *= 2) * sizeof(GeometryRange));
+
+		memmove(&pool->ranges[index + 1], &pool->ranges[index], (pool->rangeCount++ - index) * sizeof(GeometryRange));
+		pool->ranges[index] = (GeometryRange){offset, count};
+	}
+}
+
+Handle insertMesh(Mesh mesh, Vertex *meshVertices, uint32_t *meshIndices)
+{
+	printlog(vertexPool.mapped || mesh.vertexCount * sizeof(Vertex) + mesh.indexCount * sizeof(uint32_t) <=
+	 GEOMETRY_STAGING, NULL);
+
+	mesh.firstVertex = allocateGeometry(&vertexPool, mesh.vertexCount, UINT32_MAX);
+	mesh.firstIndex = allocateGeometry(&indexPool, mesh.indexCount, UINT32_MAX);
+	mesh.state = MESH_PENDING;
+	printlog(mesh.firstVertex != UINT32_MAX && mesh.firstIndex != UINT32_MAX,
+	 "Geometry Pool Exhausted: %u Vertices, %u Indices", mesh.vertexCount, mesh.indexCount);
+
+	Handle handle = acquireHandle(&meshTable);
+	*lookupMesh(handle) = mesh;
+
+	if(geometryUploadCount == geometryUploadLimit)
+		geometryUploads = reallocateHost(HOST_GEOMETRY, geometryUploads, (geometryUploadLimit = geometryUploadLimit ?
+		 2 * geometryUploadLimit : 16) * sizeof(GeometryUpload));
+
+	GeometryUpload *upload = &geometryUploads[geometryUploadCount++];
+	*upload = (GeometryUpload){handle, allocateHost(HOST_GEOMETRY, mesh.vertexCount * sizeof(Vertex)),
+	 allocateHost(HOST_GEOMETRY, mesh.indexCount * sizeof(uint32_t))};
+	memcpy(upload->vertices, meshVertices, mesh.vertexCount * sizeof(Vertex));
+	memcpy(upload->indices, meshIndices, mesh.indexCount * sizeof(uint32_t));
+
+	geometryInserted++;
+	return handle;
+}
+
+void deferGeometry(GeometryRelease release)
+{
+	if(geometryReleaseCount == geometryReleaseLimit)
+		geometryReleases = reallocateHost(HOST_GEOMETRY, geometryReleases, (geometryReleaseLimit = geometryReleaseLimit ?
+		 2 * geometryReleaseLimit : 16) * sizeof(GeometryRelease));
+
+	geometryReleases[geometryReleaseCount++] = release;
+}
+
+void removeMesh(Handle handle)
+{
+	Mesh *mesh = lookupMesh(handle);
+
+	if(mesh->state == MESH_PENDING)
+	{
+		uint32_t index = 0;
+		while(geometryUploads[index].mesh != handle)
+			index++;
+
+		freeHost(geometryUploads[index].vertices);
+		freeHost(geometryUploads[index].indices);
+		memmove(&geometryUploads[index], &geometryUploads[index + 1],
+		 (--geometryUploadCount - index) * sizeof(GeometryUpload));
+
+		releaseGeometry(&vertexPool, mesh->firstVertex, mesh->vertexCount);
+		releaseGeometry(&indexPool, mesh->firstIndex, mesh->indexCount);
+	}
+
+	// Frames still in flight may read the ranges, so they are only reused once those frames retire
+	else
+		deferGeometry((GeometryRelease){mesh->firstVertex, mesh->vertexCount, mesh->firstIndex, mesh->indexCount,
+		 frameCount});
+
+	mesh->state = MESH_FREE;
+	markPartition(mesh - meshes);
+	releaseHandle(&meshTable, handle);
+	geometryRemoved++;
+}
+
+void collectGeometry()
+{
+	uint32_t kept = 0;
+
+	for(uint32_t index = 0; index < geometryReleaseCount; index++)
+	{
+		GeometryRelease *release = &geometryReleases[index];
+
+		if(frameCount < release->frame + framebufferLimit)
+			geometryReleases[kept++] = *release;
+		else
+		{
+			if(release->vertexCount)
+				releaseGeometry(&vertexPool, release->vertexOffset, release->vertexCount);
+			if(release->indexCount)
+				releaseGeometry(&indexPool, release->indexOffset, release->indexCount);
+		}
+	}
+
+	geometryReleaseCount = kept;
+}
+
+double geometryFragmentation(GeometryPool *pool)
+{
+	// Share of the span below the free tail that is holes, which is what compaction can win back
+	GeometryRange *tail = pool->rangeCount ? &pool->ranges[pool->rangeCount - 1] : NULL;
+	uint32_t extent = tail && tail->offset + tail->count == pool->capacity ? tail->offset : pool->capacity;
+	return extent ? 1.0 - (double)pool->used / extent : 0.0;
+}
+
+VkDeviceSize compactGeometry(VkCommandBuffer commandBuffer, GeometryPool *pool, uint32_t vertex, VkDeviceSize budget)
+{
+	double fragmentation = geometryFragmentation(pool);
+	if(!pool->compacting && fragmentation > DEFRAG_THRESHOLD)
+	{
+		pool->compacting = 1;
+		pool->moves = 0;
+		pool->moved = 0;
+		pool->fragmentation = fragmentation;
+		pool->frame = frameCount;
+	}
+
+	if(!pool->compacting)
+		return 0;
+
+	VkDeviceSize moved = 0;
+	uint32_t ceiling = UINT32_MAX;
+
+	// Take meshes from the top of the pool down and drop each into the lowest hole below it that fits
+	while(moved < budget)
+	{
+		uint32_t slot = UINT32_MAX, offset = 0;
+		for(uint32_t index = 0; index < meshTable.count; index++)
+		{
+			uint32_t first = vertex ? meshes[index].firstVertex : meshes[index].firstIndex;
+			if(meshes[index].state == MESH_READY && first < ceiling && (slot == UINT32_MAX || first > offset))
+			{
+				slot = index;
+				offset = first;
+			}
+		}
+
+		if(slot == UINT32_MAX)
+			break;
+
+		Mesh *mesh = &meshes[slot];
+		uint32_t count = vertex ? mesh->vertexCount : mesh->indexCount;
+		uint32_t target = !moved || count * pool->stride <= budget - moved ?
+		 allocateGeometry(pool, count, offset) : UINT32_MAX;
+
+		if(target == UINT32_MAX)
+		{
+			ceiling = offset;
+			continue;
+		}
+
+		// The hole lies wholly below the mesh, so source and destination never overlap
+		vkCmdCopyBuffer(commandBuffer, lookupBuffer(pool->buffer), lookupBuffer(pool->buffer), 1,
+		 &(VkBufferCopy){offset * pool->stride, target * pool->stride, count * pool->stride});
+		deferGeometry(vertex ? (GeometryRelease){offset, count, 0, 0, frameCount} :
+		 (GeometryRelease){0, 0, offset, count, frameCount});
+		*(vertex ? &mesh->firstVertex : &mesh->firstIndex) = target;
+		markPartition(slot);
+
+		moved += count * pool->stride;
+		pool->moves++;
+		pool->frame = frameCount;
+	}
+
+	pool->moved += moved;
+	defragMoved += moved;
+
+	// Vacated ranges only turn into holes once the frames reading them retire, so wait that long to report
+	if(!moved && frameCount >= pool->frame + framebufferLimit)
+	{
+		printlog(1, "Compact %s Pool: %.3f to %.3f Fragmentation, %u Moves, %.3f MB", vertex ? "Vertex" : "Index",
+		 pool->fragmentation, fragmentation, pool->moves, pool->moved / 1048576.0);
+		defragMoves += pool->moves;
+		pool->compacting = 0;
+	}
+
+	return moved;
+}
+
+uint32_t defragmentGeometry(VkCommandBuffer commandBuffer)
+{
+	if(!vertexPool.compacting && !indexPool.compacting && geometryFragmentation(&vertexPool) <= DEFRAG_THRESHOLD &&
+	 geometryFragmentation(&indexPool) <= DEFRAG_THRESHOLD)
+		return 0;
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+	 1, &barrier, 0, NULL, 0, NULL);
+
+	VkDeviceSize moved = compactGeometry(commandBuffer, &vertexPool, 1, DEFRAG_BUDGET);
+	moved += compactGeometry(commandBuffer, &indexPool, 0, DEFRAG_BUDGET > moved ? DEFRAG_BUDGET - moved : 0);
+
+	if(!moved)
+		return 0;
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+	 1, &barrier, 0, NULL, 0, NULL);
+	return 1;
+}
+
+void churnGeometry()
+{
+	// Swap one synthetic mesh a frame for another of random size, so the pools fragment like streamed geometry would
+	uint32_t slot = rand() % CHURN_MESHES, count = 3 + rand() % CHURN_VERTICES;
+	if(churnMeshes[slot] != HANDLE_NULL)
+		removeMesh(churnMeshes[slot]);
+
+	// Every index points at the same vertex, so the triangles are degenerate and never rasterize
+	Vertex *churnVertices = allocateArena(count * sizeof(Vertex));
+	uint32_t *churnIndices = allocateArena(count * sizeof(uint32_t));
+	memset(churnVertices, 0, count * sizeof(Vertex));
+	memset(churnIndices, 0, count * sizeof(uint32_t));
+	churnMeshes[slot] = insertMesh((Mesh){0, count, 0, count, 1, 0, -1, {0.0f, 0.0f, 0.0f}, MESH_PENDING},
+	 churnVertices, churnIndices);
+}
+
+uint32_t uploadGeometry(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	VkDeviceSize base = (VkDeviceSize)frame * GEOMETRY_STAGING, used = 0;
+	uint32_t count = 0;
+	printlog(vertexPool.mapped || frame < geometrySlots, NULL);
+
+	for(; count < geometryUploadCount; count++)
+	{
+		GeometryUpload *upload = &geometryUploads[count];
+		Mesh *mesh = lookupMesh(upload->mesh);
+		VkDeviceSize vertexBytes = mesh->vertexCount * sizeof(Vertex), indexBytes = mesh->indexCount * sizeof(uint32_t);
+
+		if(vertexPool.mapped)
+		{
+			double start = measureTime();
+			memcpy(vertexPool.mapped + mesh->firstVertex * sizeof(Vertex), upload->vertices, vertexBytes);
+			memcpy(indexPool.mapped + mesh->firstIndex * sizeof(uint32_t), upload->indices, indexBytes);
+			uploadDirect += vertexBytes + indexBytes;
+			uploadDirectTime += measureTime() - start;
+			uploadCopies += 2;
+			freeHost(upload->vertices);
+			freeHost(upload->indices);
+			mesh->state = MESH_READY;
+			markPartition(mesh - meshes);
+			continue;
+		}
+
+		if(used + vertexBytes + indexBytes > GEOMETRY_STAGING)
+			break;
+
+		uploadStaged += vertexBytes + indexBytes;
+		memcpy(geometryMapped + base + used, upload->vertices, vertexBytes);
+		vkCmdCopyBuffer(commandBuffer, lookupBuffer(geometryStaging), lookupBuffer(vertexPool.buffer), 1,
+		 &(VkBufferCopy){base + used, mesh->firstVertex * sizeof(Vertex), vertexBytes});
+		used += vertexBytes;
+
+		memcpy(geometryMapped + base + used, upload->indices, indexBytes);
+		vkCmdCopyBuffer(commandBuffer, lookupBuffer(geometryStaging), lookupBuffer(indexPool.buffer), 1,
+		 &(VkBufferCopy){base + used, mesh->firstIndex * sizeof(uint32_t), indexBytes});
+		used += indexBytes;
+
+		freeHost(upload->vertices);
+		freeHost(upload->indices);
+		mesh->state = MESH_READY;
+		markPartition(mesh - meshes);
+	}
+
+	if(!count)
+		return 0;
+
+	memmove(geometryUploads, &geometryUploads[count], (geometryUploadCount -= count) * sizeof(GeometryUpload));
+
+	// New ranges are never read by a frame in flight, and the submission itself publishes the host writes
+	if(vertexPool.mapped)
+		return 0;
+
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+	 1, &barrier, 0, NULL, 0, NULL);
+	return count;
+}
+
+Handle insertGround()
+{
+	Vertex groundVertices[] = {
+		{{{-10.0f, -10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.03125f, 0.84375f}}},
+		{{{ 10.0f, -10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.125f,   0.84375f}}},
+		{{{ 10.0f,  10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.125f,   0.9375f}}},
+		{{{-10.0f,  10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.03125f, 0.9375f}}}};
+	uint32_t groundIndices[] = {0, 1, 2, 0, 2, 3};
+
+	return insertMesh((Mesh){0, 6, 0, 4, 1, 0, -1, {0.0f, 0.0f, 0.0f}, MESH_PENDING}, groundVertices, groundIndices);
+}
+
+void createGeometry()
+{
+	createGeometryPool(&vertexPool, vertexCount * 2 > GEOMETRY_VERTICES ? vertexCount * 2 : GEOMETRY_VERTICES,
+	 sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	createGeometryPool(&indexPool, indexCount * 2 > GEOMETRY_INDICES ? indexCount * 2 : GEOMETRY_INDICES,
+	 sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+	// The loaded models are packed back to back, so first fit hands every mesh the range it already has
+	for(uint32_t meshIndex = 0; meshIndex < meshTable.count; meshIndex++)
+	{
+		printlog(allocateGeometry(&vertexPool, meshes[meshIndex].vertexCount, UINT32_MAX) ==
+		 meshes[meshIndex].firstVertex && allocateGeometry(&indexPool, meshes[meshIndex].indexCount, UINT32_MAX) ==
+		 meshes[meshIndex].firstIndex, NULL);
+		meshes[meshIndex].state = MESH_READY;
+	}
+
+	uploadBuffer(vertexPool.buffer, 0, vertices, vertexCount * vertexSize);
+	uploadBuffer(indexPool.buffer, 0, indices, indexCount * indexSize);
+	freeHost(vertices);
+	freeHost(indices);
+
+	// Pools that are written in place need no staging ring for runtime insertions
+	if(!vertexPool.mapped)
+	{
+		geometrySlots = framebufferLimit;
+		geometryStaging = createBufferHandle(geometrySlots * GEOMETRY_STAGING, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		geometryMapped = lookupBufferMemory(geometryStaging)->mapped;
+	}
+	groundMesh = insertGround();
+	for(uint32_t slot = 0; slot < CHURN_MESHES; slot++)
+		churnMeshes[slot] = HANDLE_NULL;
+
+	printlog(1, "Create Geometry Pool: %lu of %u Vertices, %lu of %u Indices", vertexCount, vertexPool.capacity,
+	 indexCount, indexPool.capacity);
+}
+
+void reportGeometry()
+{
+	printlog(1, "Geometry Pool: %lu Inserted, %lu Removed, %u of %u Vertices, %u of %u Indices, %u Free Ranges",
+	 geometryInserted, geometryRemoved, vertexPool.used, vertexPool.capacity, indexPool.used, indexPool.capacity,
+	 vertexPool.rangeCount + indexPool.rangeCount);
+	printlog(1, "Geometry Compaction: %lu Moves, %.3f MB Moved, %.3f Vertex and %.3f Index Fragmentation",
+	 defragMoves, defragMoved / 1048576.0, geometryFragmentation(&vertexPool), geometryFragmentation(&indexPool));
+}
+
+void cleanupGeometry()
+{
+	for(uint32_t index = 0; index < geometryUploadCount; index++)
+	{
+		freeHost(geometryUploads[index].vertices);
+		freeHost(geometryUploads[index].indices);
+	}
+
+	if(geometryStaging != HANDLE_NULL)
+		destroyHandle(&bufferTable, geometryStaging);
+	destroyHandle(&bufferTable, indexPool.buffer);
+	destroyHandle(&bufferTable, vertexPool.buffer);
+
+	freeHost(indexPool.ranges);
+	freeHost(vertexPool.ranges);
+	freeHost(geometryUploads);
+	freeHost(geometryReleases);
+}
+
+void createRingBuffer()
+{
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	ringAlignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
+
+	ringBuffer = createBufferHandle(framebufferLimit * RING_FRAME, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+	 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	ringMapped = lookupBufferMemory(ringBuffer)->mapped;
+
+	printlog(1, "Create Ring Buffer: %u x %.3f KB, Alignment = %lu bytes", framebufferLimit, RING_FRAME / 1024.0,
+	 ringAlignment);
+}
+
+void resetRing(uint32_t frame)
+{
+	ringBase = (VkDeviceSize)frame * RING_FRAME;
+	ringHead = 0;
+}
+
+uint32_t allocateRing(VkDeviceSize size, void **data)
+{
+	VkDeviceSize offset = (ringHead + ringAlignment - 1) & ~(ringAlignment - 1);
+	printlog(offset + size <= RING_FRAME, NULL);
+
+	ringHead = offset + size;
+	ringPeak = ringHead > ringPeak ? ringHead : ringPeak;
+	*data = ringMapped + ringBase + offset;
+	return ringBase + offset;
+}
+
+void createObjectBuffer(uint32_t frame, uint32_t limit)
+{
+	objectLimits[frame] = limit;
+	objectBuffers[frame] = createBufferHandle(limit * sizeof(ObjectBufferObject), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+	 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+}
+
+void createObjectBuffers()
+{
+	// Objects are packed by mesh slot and read through the instance index, so they take no ring alignment
+	uint32_t limit = OBJECT_MINIMUM;
+	while(limit < meshTable.count)
+		limit *= 2;
+
+	objectBuffers = allocateHost(HOST_DEVICE, framebufferLimit * sizeof(Handle));
+	objectLimits = allocateHost(HOST_DEVICE, framebufferLimit * sizeof(uint32_t));
+	for(uint32_t frame = 0; frame < framebufferLimit; frame++)
+		createObjectBuffer(frame, limit);
+
+	printlog(1, "Create Object Buffers: %u x %u Objects", framebufferLimit, limit);
+}
+
+void growObjectBuffer(uint32_t frame)
+{
+	uint32_t limit = objectLimits[frame];
+	while(limit < meshTable.count)
+		limit *= 2;
+
+	// Only called once the slot has retired, so its buffer and descriptor set are no longer in use
+	destroyHandle(&bufferTable, objectBuffers[frame]);
+	createObjectBuffer(frame, limit);
+
+	VkDescriptorBufferInfo objectInfo = {};
+	objectInfo.buffer = lookupBuffer(objectBuffers[frame]);
+	objectInfo.offset = 0;
+	objectInfo.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet objectDescriptorWrite = {};
+	objectDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	objectDescriptorWrite.dstSet = descriptorSets[frame];
+	objectDescriptorWrite.dstBinding = 6;
+	objectDescriptorWrite.dstArrayElement = 0;
+	objectDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	objectDescriptorWrite.descriptorCount = 1;
+	objectDescriptorWrite.pBufferInfo = &objectInfo;
+
+	vkUpdateDescriptorSets(device, 1, &objectDescriptorWrite, 0, NULL);
+	invalidateFrame(frame);
+}
+
+void createFeedbackBuffer(uint32_t frame)
+{
+	// The slot keeps the size its buffer was made with, so its uniforms never describe a buffer it isn't bound to
+	feedbackExtents[frame] = (VkExtent2D){feedbackWidth, feedbackHeight};
+	VkDeviceSize feedbackSize = (feedbackWidth * feedbackHeight + 2 * RESIDENCY_TEXTURES) * sizeof(uint32_t);
+
+	feedbackBuffers[frame] = createBufferHandle(feedbackSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+	 VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	feedbackData[frame] = lookupBufferMemory(feedbackBuffers[frame])->mapped;
+	memset(feedbackData[frame], 0, feedbackSize);
+}
+
+void createFeedbackBuffers()
+{
+	feedbackWidth = (swapchainExtent.width + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+	feedbackHeight = (swapchainExtent.height + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+	feedbackBuffers = allocateHost(HOST_SWAPCHAIN, framebufferLimit * sizeof(Handle));
+	feedbackData = allocateHost(HOST_SWAPCHAIN, framebufferLimit * sizeof(uint32_t*));
+	feedbackExtents = allocateHost(HOST_SWAPCHAIN, framebufferLimit * sizeof(VkExtent2D));
+
+	for(uint32_t feedbackIndex = 0; feedbackIndex < framebufferLimit; feedbackIndex++)
+		createFeedbackBuffer(feedbackIndex);
+
+	printlog(1, "Create Feedback Buffers: %u x %u", feedbackWidth, feedbackHeight);
+}
+
+void resizeFeedback(uint32_t frame)
+{
+	// Called once the slot has retired, so neither its buffer nor its descriptor set is in use any more
+	destroyHandle(&bufferTable, feedbackBuffers[frame]);
+	createFeedbackBuffer(frame);
+
+	VkDescriptorBufferInfo feedbackInfo = {};
+	feedbackInfo.buffer = lookupBuffer(feedbackBuffers[frame]);
+	feedbackInfo.offset = 0;
+	feedbackInfo.range = VK_WHOLE_SIZE;
+
+	VkWriteDescriptorSet feedbackDescriptorWrite = {};
+	feedbackDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	feedbackDescriptorWrite.dstSet = descriptorSets[frame];
+	feedbackDescriptorWrite.dstBinding = 4;
+	feedbackDescriptorWrite.dstArrayElement = 0;
+	feedbackDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	feedbackDescriptorWrite.descriptorCount = 1;
+	feedbackDescriptorWrite.pBufferInfo = &feedbackInfo;
+
+	vkUpdateDescriptorSets(device, 1, &feedbackDescriptorWrite, 0, NULL);
+	feedbackStale &= ~(1u << frame);
+	invalidateFrame(frame);
+}
+
+void createDescriptorPool()
+{
+	VkDescriptorPoolSize uniformBufferSize = {};
+	uniformBufferSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	uniformBufferSize.descriptorCount = framebufferLimit;
+
+	VkDescriptorPoolSize imageSamplerSize = {};
+	imageSamplerSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	imageSamplerSize.descriptorCount = 4 * framebufferLimit;
+
+	VkDescriptorPoolSize storageBufferSize = {};
+	storageBufferSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	storageBufferSize.descriptorCount = 2 * framebufferLimit;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = framebufferLimit;
+	poolInfo.poolSizeCount = 3;
+	poolInfo.pPoolSizes = (VkDescriptorPoolSize[]){uniformBufferSize, imageSamplerSize, storageBufferSize};
+
+	printlog(vkCreateDescriptorPool(device, &poolInfo, NULL, &descriptorPool) == VK_SUCCESS,
+	 "Create Descriptor Pool");
+}
+
+void createDescriptorSets()
+{
+	VkDescriptorSetLayout *layouts = allocateHost(HOST_SWAPCHAIN, framebufferLimit * sizeof(VkDescriptorSetLayout));
+	for(uint32_t layoutIndex = 0; layoutIndex < framebufferLimit; layoutIndex++)
+		layouts[layoutIndex] = descriptorSetLayout;
+
+	VkDescriptorSetAllocateInfo descriptorSetInfo = {};
+	descriptorSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetInfo.descriptorPool = descriptorPool;
+	descriptorSetInfo.descriptorSetCount = framebufferLimit;
+	descriptorSetInfo.pSetLayouts = layouts;
+
+	descriptorSets = allocateHost(HOST_SWAPCHAIN, framebufferLimit * sizeof(VkDescriptorSet));
+	printlog(vkAllocateDescriptorSets(device, &descriptorSetInfo, descriptorSets) == VK_SUCCESS,
+	 "Allocate Descriptor Sets");
+	freeHost(layouts);
+
+	for(uint32_t layoutIndex = 0; layoutIndex < framebufferLimit; layoutIndex++)
+	{
+		VkDescriptorBufferInfo bufferInfo = {};
+		bufferInfo.buffer = lookupBuffer(ringBuffer);
+		bufferInfo.offset = 0;
+		bufferInfo.range = sizeof(UniformBufferObject);
+
+		VkDescriptorBufferInfo objectInfo = {};
+		objectInfo.buffer = lookupBuffer(objectBuffers[layoutIndex]);
+		objectInfo.offset = 0;
+		objectInfo.range = VK_WHOLE_SIZE;
+
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = lookupView(textureHandle);
+		imageInfo.sampler = lookupSampler(textureSampler);
+
+		VkDescriptorImageInfo pageInfo = {};
+		pageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		pageInfo.imageView = lookupView(pageHandle);
+		pageInfo.sampler = lookupSampler(pageSampler);
+
+		VkDescriptorImageInfo atlasInfo = {};
+		atlasInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		atlasInfo.imageView = lookupView(atlasHandle);
+		atlasInfo.sampler = lookupSampler(atlasSampler);
+
+		VkDescriptorImageInfo packedInfo = {};
+		packedInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		packedInfo.imageView = lookupView(packedHandle);
+		packedInfo.sampler = lookupSampler(packedSampler);
+
+		VkDescriptorBufferInfo feedbackInfo = {};
+		feedbackInfo.buffer = lookupBuffer(feedbackBuffers[layoutIndex]);
+		feedbackInfo.offset = 0;
+		feedbackInfo.range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet bufferDescriptorWrite = {};
+		bufferDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		bufferDescriptorWrite.dstSet = descriptorSets[layoutIndex];
+		bufferDescriptorWrite.dstBinding = 0;
+		bufferDescriptorWrite.dstArrayElement = 0;
+		bufferDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		bufferDescriptorWrite.descriptorCount = 1;
+		bufferDescriptorWrite.pBufferInfo = &bufferInfo;
+
+		VkWriteDescriptorSet objectDescriptorWrite = {};
+		objectDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		objectDescriptorWrite.dstSet = descriptorSets[layoutIndex];
+		objectDescriptorWrite.dstBinding = 6;
+		objectDescriptorWrite.dstArrayElement = 0;
+		objectDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		objectDescriptorWrite.descriptorCount = 1;
+		objectDescriptorWrite.pBufferInfo = &objectInfo;
+
+		VkWriteDescriptorSet samplerDescriptorWrite = {};
+		samplerDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		samplerDescriptorWrite.dstSet = descriptorSets[layoutIndex];
+		samplerDescriptorWrite.dstBinding = 1;
+		samplerDescriptorWrite.dstArrayElement = 0;
+		samplerDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		samplerDescriptorWrite.descriptorCount = 1;
+		samplerDescriptorWrite.pImageInfo = &imageInfo;
+
+		VkWriteDescriptorSet virtualDescriptorWrite = {};
+		virtualDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		virtualDescriptorWrite.dstSet = descriptorSets[layoutIndex];
+		virtualDescriptorWrite.dstBinding = 2;
+		virtualDescriptorWrite.dstArrayElement = 0;
+		virtualDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		virtualDescriptorWrite.descriptorCount = 2;
+		virtualDescriptorWrite.pImageInfo = (VkDescriptorImageInfo[]){pageInfo, atlasInfo};
+
+		VkWriteDescriptorSet feedbackDescriptorWrite = {};
+		feedbackDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		feedbackDescriptorWrite.dstSet = descriptorSets[layoutIndex];
+		feedbackDescriptorWrite.dstBinding = 4;
+		feedbackDescriptorWrite.dstArrayElement = 0;
+		feedbackDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		feedbackDescriptorWrite.descriptorCount = 1;
+		feedbackDescriptorWrite.pBufferInfo = &feedbackInfo;
+
+		VkWriteDescriptorSet packedDescriptorWrite = {};
+		packedDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		packedDescriptorWrite.dstSet = descriptorSets[layoutIndex];
+		packedDescriptorWrite.dstBinding = 5;
+		packedDescriptorWrite.dstArrayElement = 0;
+		packedDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		packedDescriptorWrite.descriptorCount = 1;
+		packedDescriptorWrite.pImageInfo = &packedInfo;
+
+		vkUpdateDescriptorSets(device, 6, (VkWriteDescriptorSet[]){bufferDescriptorWrite, samplerDescriptorWrite,
+		 virtualDescriptorWrite, feedbackDescriptorWrite, packedDescriptorWrite, objectDescriptorWrite}, 0, NULL);
+	}
+
+	printlog(1, "Update Descriptor Sets");
+}
+
+void markPartition(uint32_t slot)
+{
+	// Every frame slot holds its own copy of a partition, each re-recorded once it falls behind the version
+	if(slot / RECORD_PARTITION < partitionLimit)
+		partitionVersions[slot / RECORD_PARTITION]++;
+}
+
+void invalidatePartitions()
+{
+	for(uint32_t partition = 0; partition < partitionLimit; partition++)
+		partitionVersions[partition]++;
+}
+
+void invalidateFrame(uint32_t frame)
+{
+	// A descriptor write only breaks the copies recorded against that slot's set, so the other slots keep theirs
+	for(uint32_t partition = 0; partition < partitionLimit; partition++)
+		partitionCache[partition * framebufferLimit + frame].version = 0;
+}
+
+void recordPartition(uint32_t partition)
+{
+	// Partitions cover fixed ranges of mesh slots, so a change only touches the partition holding the mesh
+	RecordPartition *cache = &partitionCache[partition * framebufferLimit + recordFrame];
+	uint32_t first = partition * RECORD_PARTITION;
+	uint32_t last = first + RECORD_PARTITION < meshTable.count ? first + RECORD_PARTITION : meshTable.count;
+
+	VkCommandBufferInheritanceRenderingInfo renderingInfo = {};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachmentFormats = &swapchainFormat;
+	renderingInfo.depthAttachmentFormat = depthAttachmentFormat;
+	renderingInfo.rasterizationSamples = msaaSamples;
+
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.pNext = dynamicRendering ? &renderingInfo : NULL;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+	vkBeginCommandBuffer(cache->commandBuffer, &beginInfo);
+	vkCmdBindPipeline(cache->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recordPipeline);
+
+	// Secondary command buffers inherit no dynamic state, so every partition sets its own
+	VkViewport viewport = {0.0f, 0.0f, (float)swapchainExtent.width, (float)swapchainExtent.height, 0.0f, 1.0f};
+	VkRect2D scissor = {(VkOffset2D){}, swapchainExtent};
+	vkCmdSetViewport(cache->commandBuffer, 0, 1, &viewport);
+	vkCmdSetScissor(cache->commandBuffer, 0, 1, &scissor);
+	if(dynamicState)
+	{
+		vkCmdSetCullMode(cache->commandBuffer, cullMode ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT);
+		vkCmdSetFrontFace(cache->commandBuffer, VK_FRONT_FACE_CLOCKWISE);
+		vkCmdSetDepthTestEnable(cache->commandBuffer, depthMode ? VK_FALSE : VK_TRUE);
+		vkCmdSetDepthWriteEnable(cache->commandBuffer, depthMode ? VK_FALSE : VK_TRUE);
+	}
+	if(dynamicPolygon)
+		setPolygonMode(cache->commandBuffer, fillMode ? VK_POLYGON_MODE_LINE : VK_POLYGON_MODE_FILL);
+	vkCmdBindVertexBuffers(cache->commandBuffer, 0, 1, &recordVertices, (VkDeviceSize[]){0});
+	vkCmdBindIndexBuffer(cache->commandBuffer, recordIndices, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindDescriptorSets(cache->commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, recordLayout, 0, 1,
+	 &descriptorSets[recordFrame], 1, &recordOffset);
+
+	cache->draws = 0;
+	for(uint32_t meshIndex = first; meshIndex < last; meshIndex++)
+	{
+		Mesh *mesh = &meshes[meshIndex];
+		if(mesh->state != MESH_READY)
+			continue;
+
+		// The first instance carries the mesh slot, which the shaders use to find the object
+		vkCmdDrawIndexed(cache->commandBuffer, mesh->indexCount, 1, mesh->firstIndex, mesh->firstVertex, meshIndex);
+		cache->draws++;
+	}
+
+	vkEndCommandBuffer(cache->commandBuffer);
+	cache->version = partitionVersions[partition];
+}
+
+void recordStale(uint32_t thread)
+{
+	// A partition is only ever recorded by the thread owning the pool it was allocated from
+	for(uint32_t partition = thread; partition < partitionCount; partition += recordThreads)
+		if(partitionCache[partition * framebufferLimit + recordFrame].version != partitionVersions[partition])
+			recordPartition(partition);
+}
+
+void *recordWorker(void *argument)
+{
+	uint32_t thread = (uintptr_t)argument, generation = 0;
+
+	pthread_mutex_lock(&recordMutex);
+	while(recordRunning)
+	{
+		if(generation == recordGeneration)
+		{
+			pthread_cond_wait(&recordSignal, &recordMutex);
+			continue;
+		}
+
+		generation = recordGeneration;
+		pthread_mutex_unlock(&recordMutex);
+
+		recordStale(thread);
+
+		pthread_mutex_lock(&recordMutex);
+		if(!--recordPending)
+			pthread_cond_signal(&recordDone);
+	}
+	pthread_mutex_unlock(&recordMutex);
+
+	return NULL;
+}
+
+void createPartitions()
+{
+	// Cached partitions are reset one at a time when they go stale, so these pools cannot be transient
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = graphicsIndex;
+
+	recordPools = allocateHost(HOST_SWAPCHAIN, framebufferLimit * recordThreads * sizeof(VkCommandPool));
+	for(uint32_t poolIndex = 0; poolIndex < framebufferLimit * recordThreads; poolIndex++)
+		printlog(vkCreateCommandPool(device, &poolInfo, NULL, &recordPools[poolIndex]) == VK_SUCCESS, NULL);
+
+	partitionCache = NULL;
+	partitionVersions = NULL;
+	partitionCount = partitionLimit = 0;
+}
+
+void growPartitions(uint32_t count)
+{
+	if(count <= partitionLimit)
+		return;
+
+	partitionCache = reallocateHost(HOST_SWAPCHAIN, partitionCache, count * framebufferLimit * sizeof(RecordPartition));
+	partitionVersions = reallocateHost(HOST_SWAPCHAIN, partitionVersions, count * sizeof(uint32_t));
+
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	allocateInfo.commandBufferCount = 1;
+
+	for(uint32_t partition = partitionLimit; partition < count; partition++)
+	{
+		partitionVersions[partition] = 1;
+		for(uint32_t frameIndex = 0; frameIndex < framebufferLimit; frameIndex++)
+		{
+			RecordPartition *cache = &partitionCache[partition * framebufferLimit + frameIndex];
+			allocateInfo.commandPool = recordPools[frameIndex * recordThreads + partition % recordThreads];
+			printlog(vkAllocateCommandBuffers(device, &allocateInfo, &cache->commandBuffer) == VK_SUCCESS, NULL);
+			cache->version = 0;
+			cache->draws = 0;
+		}
+	}
+
+	partitionLimit = count;
+}
+
+void cleanupPartitions()
+{
+	for(uint32_t poolIndex = 0; poolIndex < framebufferLimit * recordThreads; poolIndex++)
+		vkDestroyCommandPool(device, recordPools[poolIndex], NULL);
+
+	freeHost(partitionVersions);
+	freeHost(partitionCache);
+	freeHost(recordPools);
+	partitionLimit = 0;
+}
+
+void createRecording()
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	recordThreads = cores < 1 ? 1 : cores < RECORD_THREADS ? cores : RECORD_THREADS;
+
+	// Primaries are rewritten every frame, so each frame in flight has a transient pool for its own
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	poolInfo.queueFamilyIndex = graphicsIndex;
+
+	VkCommandBufferAllocateInfo allocateInfo = {};
+	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocateInfo.commandBufferCount = 1;
+
+	framePools = allocateHost(HOST_DEVICE, framebufferLimit * sizeof(VkCommandPool));
+	frameCommands = allocateHost(HOST_DEVICE, framebufferLimit * sizeof(VkCommandBuffer));
+
+	for(uint32_t frameIndex = 0; frameIndex < framebufferLimit; frameIndex++)
+	{
+		printlog(vkCreateCommandPool(device, &poolInfo, NULL, &framePools[frameIndex]) == VK_SUCCESS, NULL);
+		allocateInfo.commandPool = framePools[frameIndex];
+		printlog(vkAllocateCommandBuffers(device, &allocateInfo, &frameCommands[frameIndex]) == VK_SUCCESS, NULL);
+	}
+
+	createPartitions();
+
+	pthread_mutex_init(&recordMutex, NULL);
+	pthread_cond_init(&recordSignal, NULL);
+	pthread_cond_init(&recordDone, NULL);
+	recordRunning = 1;
+
+	// The main thread records the partitions of the first pool itself
+	recordWorkers = allocateHost(HOST_DEVICE, recordThreads * sizeof(pthread_t));
+	for(uint32_t thread = 1; thread < recordThreads; thread++)
+		pthread_create(&recordWorkers[thread], NULL, recordWorker, (void*)(uintptr_t)thread);
+
+	printlog(1, "Create Command Recording: %u Threads, %u Partition Pools", recordThreads,
+	 framebufferLimit * recordThreads);
+}
+
+void beginFrameRendering(VkCommandBuffer commandBuffer, uint32_t image)
+{
+	VkClearValue clearValues[2] = {};
+	clearValues[0].color.float32[0] = 0.0f;
+	clearValues[0].color.float32[1] = 0.0f;
+	clearValues[0].color.float32[2] = 0.0f;
+	clearValues[0].color.float32[3] = 1.0f;
+	clearValues[1].depthStencil.depth = 1.0f;
+	clearValues[1].depthStencil.stencil = 0;
+
+	if(!dynamicRendering)
+	{
+		VkRenderPassBeginInfo renderPassBeginInfo = {};
+		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassBeginInfo.renderPass = renderPass;
+		renderPassBeginInfo.framebuffer = swapchainFramebuffers[image];
+		renderPassBeginInfo.renderArea.offset = (VkOffset2D){};
+		renderPassBeginInfo.renderArea.extent = swapchainExtent;
+		renderPassBeginInfo.clearValueCount = 2;
+		renderPassBeginInfo.pClearValues = clearValues;
+
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		return;
+	}
+
+	// The layout transitions and the dependency on the previous frame's attachment writes, which the render pass
+	// used to imply, are spelled out here
+	VkImageMemoryBarrier barriers[3] = {};
+	VkImage images[] = {colorImage, swapchainImages[image], depthImage};
+	for(uint32_t barrierIndex = 0; barrierIndex < 3; barrierIndex++)
+	{
+		barriers[barrierIndex].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[barrierIndex].image = images[barrierIndex];
+		barriers[barrierIndex].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[barrierIndex].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		barriers[barrierIndex].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[barrierIndex].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[barrierIndex].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[barrierIndex].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+		 VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barriers[barrierIndex].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barriers[barrierIndex].subresourceRange.levelCount = 1;
+		barriers[barrierIndex].subresourceRange.layerCount = 1;
+	}
+
+	barriers[2].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	barriers[2].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[2].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+	 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	barriers[2].subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT |
+	 (depthAttachmentFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthAttachmentFormat == VK_FORMAT_D24_UNORM_S8_UINT
+	 ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+	 VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+	 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+	 VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, NULL, 0, NULL, 3, barriers);
+
+	// Neither multisampled attachment is stored, the color one is resolved straight into the swapchain image
+	VkRenderingAttachmentInfo colorAttachment = {};
+	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	colorAttachment.imageView = colorView;
+	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+	colorAttachment.resolveImageView = swapchainViews[image];
+	colorAttachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.clearValue = clearValues[0];
+
+	VkRenderingAttachmentInfo depthAttachment = {};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView = depthView;
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.clearValue = clearValues[1];
+
+	VkRenderingInfo renderingInfo = {};
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+	renderingInfo.renderArea.offset = (VkOffset2D){};
+	renderingInfo.renderArea.extent = swapchainExtent;
+	renderingInfo.layerCount = 1;
+	renderingInfo.colorAttachmentCount = 1;
+	renderingInfo.pColorAttachments = &colorAttachment;
+	renderingInfo.pDepthAttachment = &depthAttachment;
+
+	vkCmdBeginRendering(commandBuffer, &renderingInfo);
+}
+
+void endFrameRendering(VkCommandBuffer commandBuffer, uint32_t image)
+{
+	if(!dynamicRendering)
+	{
+		vkCmdEndRenderPass(commandBuffer);
+		return;
+	}
+
+	vkCmdEndRendering(commandBuffer);
+
+	VkImageMemoryBarrier presentBarrier = {};
+	presentBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	presentBarrier.image = swapchainImages[image];
+	presentBarrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	presentBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	presentBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	presentBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	presentBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	presentBarrier.dstAccessMask = 0;
+	presentBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	presentBarrier.subresourceRange.levelCount = 1;
+	presentBarrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+	 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &presentBarrier);
+}
+
+VkCommandBuffer recordCommandBuffers(uint32_t frame, uint32_t image)
+{
+	double start = measureTime();
+
+	// The slot's previous frame has retired, so neither its primary nor its cached partitions are pending
+	vkResetCommandPool(device, framePools[frame], 0);
+
+	recordFrame = frame;
+	recordPipeline = lookupPipeline(graphicsPipeline);
+	recordLayout = lookupLayout(graphicsPipeline);
+	recordVertices = lookupBuffer(vertexPool.buffer);
+	recordIndices = lookupBuffer(indexPool.buffer);
+
+	partitionCount = (meshTable.count + RECORD_PARTITION - 1) / RECORD_PARTITION;
+	growPartitions(partitionCount);
+
+	uint32_t stale = 0;
+	for(uint32_t partition = 0; partition < partitionCount; partition++)
+		stale += partitionCache[partition * framebufferLimit + frame].version != partitionVersions[partition];
+
+	partitionsRecorded += stale;
+	partitionsReused += partitionCount - stale;
+
+	// A single stale partition is recorded in place, since waking the workers costs more than it would save
+	int threaded = stale > 1 && recordThreads > 1;
+	if(threaded)
+	{
+		pthread_mutex_lock(&recordMutex);
+		recordPending = recordThreads - 1;
+		recordGeneration++;
+		pthread_cond_broadcast(&recordSignal);
+		pthread_mutex_unlock(&recordMutex);
+		recordStale(0);
+	}
+	else if(stale)
+	{
+		for(uint32_t thread = 0; thread < recordThreads; thread++)
+			recordStale(thread);
+	}
+
+	VkCommandBuffer commandBuffer = frameCommands[frame];
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkBufferMemoryBarrier feedbackBarrier = {};
+	feedbackBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	feedbackBarrier.buffer = lookupBuffer(feedbackBuffers[frame]);
+	feedbackBarrier.offset = 0;
+	feedbackBarrier.size = VK_WHOLE_SIZE;
+	feedbackBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	feedbackBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	feedbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	feedbackBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	if(frameTimestamps)
+	{
+		vkCmdResetQueryPool(commandBuffer, frameQueries, 2 * frame, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameQueries, 2 * frame);
+	}
+	vkCmdFillBuffer(commandBuffer, feedbackBarrier.buffer, 0, VK_WHOLE_SIZE, 0);
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+	 NULL, 1, &feedbackBarrier, 0, NULL);
+	beginFrameRendering(commandBuffer, image);
+
+	if(threaded)
+	{
+		pthread_mutex_lock(&recordMutex);
+		while(recordPending)
+			pthread_cond_wait(&recordDone, &recordMutex);
+		pthread_mutex_unlock(&recordMutex);
+	}
+
+	uint32_t executeCount = 0, drawCount = 0;
+	VkCommandBuffer *executes = allocateArena(partitionCount * sizeof(VkCommandBuffer));
+	for(uint32_t partition = 0; partition < partitionCount; partition++)
+	{
+		RecordPartition *cache = &partitionCache[partition * framebufferLimit + frame];
+		if(!cache->draws)
+			continue;
+
+		executes[executeCount++] = cache->commandBuffer;
+		drawCount += cache->draws;
+	}
+
+	if(executeCount)
+		vkCmdExecuteCommands(commandBuffer, executeCount, executes);
+	endFrameRendering(commandBuffer, image);
+
+	feedbackBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	feedbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+	 NULL, 1, &feedbackBarrier, 0, NULL);
+	if(frameTimestamps)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameQueries, 2 * frame + 1);
+	vkEndCommandBuffer(commandBuffer);
+
+	recordTime += measureTime() - start;
+	recordDraws += drawCount;
+	recordFrames++;
+	return commandBuffer;
+}
+
+void reportRecording()
+{
+	uint64_t partitions = partitionsReused + partitionsRecorded;
+	printlog(1, "Command Recording: %.3f ms and %.1f Draws per Frame on up to %u Threads", recordFrames ?
+	 1000.0 * recordTime / recordFrames : 0.0, recordFrames ? (double)recordDraws / recordFrames : 0.0, recordThreads);
+	printlog(1, "Command Partitions: %lu Reused, %lu Recorded, %.1f%% Reuse", partitionsReused, partitionsRecorded,
+	 partitions ? 100.0 * partitionsReused / partitions : 0.0);
+}
+
+void cleanupRecording()
+{
+	pthread_mutex_lock(&recordMutex);
+	recordRunning = 0;
+	pthread_cond_broadcast(&recordSignal);
+	pthread_mutex_unlock(&recordMutex);
+
+	for(uint32_t thread = 1; thread < recordThreads; thread++)
+		pthread_join(recordWorkers[thread], NULL);
+
+	cleanupPartitions();
+	for(uint32_t frameIndex = 0; frameIndex < framebufferLimit; frameIndex++)
+		vkDestroyCommandPool(device, framePools[frameIndex], NULL);
+
+	pthread_cond_destroy(&recordDone);
+	pthread_cond_destroy(&recordSignal);
+	pthread_mutex_destroy(&recordMutex);
+	freeHost(recordWorkers);
+	freeHost(frameCommands);
+	freeHost(framePools);
+}
+
+VkDeviceSize residentSize(ResidentTexture *texture, uint32_t level)
+{
+	VkDeviceSize size = 0;
+	for(; level < texture->levels; level++)
+		size += (VkDeviceSize)(texture->width >> level ? texture->width >> level : 1) *
+		 (texture->height >> level ? texture->height >> level : 1) * 4 * texture->layers;
+	return size;
+}
+
+uint8_t *residentPixels(ResidentTexture *texture, uint32_t level)
+{
+	uint32_t source = level < VIRTUAL_LEVELS ? level : VIRTUAL_LEVELS - 1;
+	while(source && !texture->sources[source])
+		source--;
+
+	uint32_t width = texture->width >> source ? texture->width >> source : 1;
+	uint32_t height = texture->height >> source ? texture->height >> source : 1;
+	uint32_t reduction = level < RESIDENCY_REDUCTION ? level : RESIDENCY_REDUCTION;
+	uint8_t *pixels = NULL;
+
+	if(texture->path && reduction > source)
+	{
+		int reducedWidth, reducedHeight;
+		pixels = loadReducedJpeg(texture->path, 1 << reduction, &reducedWidth, &reducedHeight);
+
+		if(pixels && (uint32_t)reducedWidth == texture->width >> reduction &&
+		 (uint32_t)reducedHeight == texture->height >> reduction)
+		{
+			source = reduction;
+			width = reducedWidth;
+			height = reducedHeight;
+		}
+		else
+		{
+			freeHost(pixels);
+			pixels = NULL;
+		}
+	}
+
+	if(!pixels)
+	{
+		pixels = allocateHost(HOST_TEXTURE, (size_t)width * height * 4 * texture->layers);
+		memcpy(pixels, texture->sources[source], (size_t)width * height * 4 * texture->layers);
+	}
+
+	for(; source < level; source++)
+	{
+		uint32_t halfWidth = width > 1 ? width / 2 : 1, halfHeight = height > 1 ? height / 2 : 1;
+		uint8_t *half = allocateHost(HOST_TEXTURE, (size_t)halfWidth * halfHeight * 4 * texture->layers);
+
+		for(uint32_t layer = 0; layer < texture->layers; layer++)
+		{
+			uint8_t *from = pixels + (size_t)layer * width * height * 4;
+			uint8_t *to = half + (size_t)layer * halfWidth * halfHeight * 4;
+
+			for(uint32_t y = 0; y < halfHeight; y++)
+			{
+				uint32_t top = 2 * y < height ? 2 * y : height - 1, bottom = 2 * y + 1 < height ? 2 * y + 1 : height - 1;
+
+				for(uint32_t x = 0; x < halfWidth; x++)
+				{
+					uint32_t left = 2 * x < width ? 2 * x : width - 1, right = 2 * x + 1 < width ? 2 * x + 1 : width - 1;
+
+					for(uint32_t channel = 0; channel < 4; channel++)
+						to[(y * halfWidth + x) * 4 + channel] = (from[(top * width + left) * 4 + channel] +
+						 from[(top * width + right) * 4 + channel] + from[(bottom * width + left) * 4 + channel] +
+						 from[(bottom * width + right) * 4 + channel] + 2) / 4;
+				}
+			}
+		}
+
+		freeHost(pixels);
+		pixels = half;
+		width = halfWidth;
+		height = halfHeight;
+	}
+
+	return pixels;
+}
+
+void createResidentView(ResidentTexture *texture, uint32_t levels)
+{
+	uint32_t slot = lookupHandle(&textureTable, *texture->texture);
 
-		uint16_t iterator = 0, hash = hashVertex(vertex);
+	VkImageViewCreateInfo viewInfo = {};
+	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	viewInfo.viewType = texture->viewType;
+	viewInfo.image = textureImages[slot];
+	viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+	viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.levelCount = levels;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.layerCount = texture->layers;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	printlog(vkCreateImageView(device, &viewInfo, NULL, &textureViews[slot]) == VK_SUCCESS, NULL);
 
-		while(iterator < hashMap[hash].size && !compareVertex(vertex, *hashMap[hash].vertices[iterator]))
-			iterator++;
+	// Sets still bound by frames in flight can't be written, so each slot picks the view up once it retires
+	texture->stale = (1u << framebufferLimit) - 1;
+}
 
-		if(iterator == hashMap[hash].size)
-		{
-			if(!hashMap[hash].limit)
-			{
-				hashMap[hash].limit = 128;
-				hashMap[hash].indices = malloc(hashMap[hash].limit * sizeof(uint32_t));
-				hashMap[hash].vertices = malloc(hashMap[hash].limit * sizeof(Vertex*));
-			}
+void updateResidentViews(uint32_t frame)
+{
+	uint32_t written = 0;
 
-			else if(hashMap[hash].size == hashMap[hash].limit)
-			{
-				hashMap[hash].limit *= 2;
-				hashMap[hash].indices = realloc(hashMap[hash].indices, hashMap[hash].limit * sizeof(uint32_t));
-				hashMap[hash].vertices = realloc(hashMap[hash].vertices, hashMap[hash].limit * sizeof(Vertex*));
-			}
+	// Called once the slot has retired, the old level set stays alive until every slot has moved off it
+	for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
+	{
+		ResidentTexture *texture = &residentTextures[textureIndex];
+		if(!(texture->stale & 1u << frame))
+			continue;
 
-			if(vertexCount + uniqueCount == vertexLimit)
-			{
-				vertexLimit *= 2;
-				vertices = realloc(vertices, vertexLimit * vertexSize);
-			}
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = lookupView(*texture->texture);
+		imageInfo.sampler = lookupSampler(*texture->sampler);
 
-			indices[indexCount + index] = hashMap[hash].indices[iterator] = vertexCount + uniqueCount;
-			vertices[vertexCount + uniqueCount] = vertex;
-			hashMap[hash].vertices[iterator] = &vertices[vertexCount + uniqueCount];
-			uniqueCount++;
-			hashMap[hash].size++;
-		}
+		VkWriteDescriptorSet samplerDescriptorWrite = {};
+		samplerDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		samplerDescriptorWrite.dstSet = descriptorSets[frame];
+		samplerDescriptorWrite.dstBinding = texture->binding;
+		samplerDescriptorWrite.dstArrayElement = 0;
+		samplerDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		samplerDescriptorWrite.descriptorCount = 1;
+		samplerDescriptorWrite.pImageInfo = &imageInfo;
 
-		else
-			indices[indexCount + index] = hashMap[hash].indices[iterator];
+		vkUpdateDescriptorSets(device, 1, &samplerDescriptorWrite, 0, NULL);
+		texture->stale &= ~(1u << frame);
+		written++;
 	}
 
-	vertexCount += uniqueCount;
-	indexCount += attributes.num_faces;
+	if(written)
+		invalidateFrame(frame);
+}
 
-	tinyobj_materials_free(materials, materialCount);
-	tinyobj_shapes_free(shapes, shapeCount);
-	tinyobj_attrib_free(&attributes);
+void loadResidentTexture(ResidentTexture *texture, uint32_t level)
+{
+	uint32_t width = texture->width >> level ? texture->width >> level : 1;
+	uint32_t height = texture->height >> level ? texture->height >> level : 1;
+	uint32_t levels = texture->levels - level;
+	VkDeviceSize imageSize = (VkDeviceSize)width * height * 4 * texture->layers;
+	uint8_t *pixels = residentPixels(texture, level);
+
+	VkBuffer stagingBuffer;
+	VkDeviceSize stagingOffset;
+	memcpy(stageUpload(imageSize, &stagingBuffer, &stagingOffset), pixels, imageSize);
+	freeHost(pixels);
+
+	// The new level set streams in on the transfer queue while the old one keeps rendering, so both stay
+	// allocated until the copy lands and the swap is made
+	texture->pending = createTextureHandle(width, height, levels, texture->layers, VK_FORMAT_R8G8B8A8_UNORM,
+	 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+	 VK_IMAGE_USAGE_SAMPLED_BIT);
+	texture->pendingLevel = level;
+	copyBufferToImage(stagingBuffer, stagingOffset, lookupImage(texture->pending), width, height, levels,
+	 texture->layers, storageMipmaps(VK_FORMAT_R8G8B8A8_UNORM) ? computeIndex : graphicsIndex);
+	texture->pendingSerial = submitUpload();
+	residencyUploaded += imageSize;
 }
 
-void createObjectModels()
+void commitResidentTexture(ResidentTexture *texture)
 {
-	vertexCount = 0;
-	vertexLimit = INT_MAX / 1024;
-	vertexSize = sizeof(Vertex);
-	vertices = malloc(vertexLimit * vertexSize);
+	uint32_t level = texture->pendingLevel;
+	uint32_t width = texture->width >> level ? texture->width >> level : 1;
+	uint32_t height = texture->height >> level ? texture->height >> level : 1;
+	uint32_t levels = texture->levels - level;
+
+	// Compute mipmaps run in the frame's compute stage, where they overlap the raster work of the frame before
+	VkImage image = lookupImage(texture->pending);
+	if(storageMipmaps(VK_FORMAT_R8G8B8A8_UNORM))
+	{
+		acquireImage(beginCompute(), image, levels, texture->layers, computeIndex);
+		waitComputeTransfer(texture->pendingSerial);
+		queueMipmaps(image, VK_FORMAT_R8G8B8A8_UNORM, width, height, levels, texture->layers, texture->filter, 1);
+		dispatchMipmaps();
+	}
 
-	indexCount = 0;
-	indexLimit = INT_MAX / 256;
-	indexSize = sizeof(uint32_t);
-	indices = malloc(indexLimit * indexSize);
+	else
+	{
+		acquireImage(beginUpload(), image, levels, texture->layers, graphicsIndex);
+		queueMipmaps(image, VK_FORMAT_R8G8B8A8_UNORM, width, height, levels, texture->layers, texture->filter, 1);
+	}
 
-	hashMap = calloc(USHRT_MAX + 1, sizeof(Node));
+	// The copy has already landed, the old level set goes once the frames in flight that sample it retire
+	destroyLater(&textureTable, *texture->texture);
+	*texture->texture = texture->pending;
+	texture->pending = HANDLE_NULL;
+	texture->committed = frameCount;
 
-	loadObject("models/chalet.obj", (float[]){-1.0f, -1.0f, 0.0f});
-	loadObject("models/chalet.obj", (float[]){-1.0f, 1.0f, 0.0f});
-	loadObject("models/chalet.obj", (float[]){1.0f, -1.0f, 0.0f});
-	loadObject("models/chalet.obj", (float[]){1.0f, 1.0f, 0.0f});
+	createResidentView(texture, levels);
 
-	vertices[vertexCount + 0] = (Vertex){{{-10.0f, -10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.03125f, 0.84375f}}};
-	vertices[vertexCount + 1] = (Vertex){{{ 10.0f, -10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.125f,   0.84375f}}};
-	vertices[vertexCount + 2] = (Vertex){{{ 10.0f,  10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.125f,   0.9375f}}};
-	vertices[vertexCount + 3] = (Vertex){{{-10.0f,  10.0f, 0.0f}, {1.0f, 1.0f, 1.0f}, {0.03125f, 0.9375f}}};
+	if(level < texture->resident)
+		residencyLoads++;
+	else
+		residencyEvictions++;
 
-	indices[indexCount + 0] = vertexCount;
-	indices[indexCount + 1] = vertexCount + 1;
-	indices[indexCount + 2] = vertexCount + 2;
-	indices[indexCount + 3] = vertexCount;
-	indices[indexCount + 4] = vertexCount + 2;
-	indices[indexCount + 5] = vertexCount + 3;
+	printlog(1, "Resident Texture: Binding %u from Level %u to %u, %.3f MB", texture->binding, texture->resident,
+	 level, residentSize(texture, level) / 1048576.0);
+	texture->resident = level;
+}
 
-	vertexCount += 4;
-	indexCount += 6;
+uint32_t relocateResidentTexture(ResidentTexture *texture, uint32_t block, VkCommandBuffer commandBuffer)
+{
+	uint32_t width = texture->width >> texture->resident ? texture->width >> texture->resident : 1;
+	uint32_t height = texture->height >> texture->resident ? texture->height >> texture->resident : 1;
+	uint32_t levels = texture->levels - texture->resident;
+
+	Handle source = *texture->texture;
+	memoryTarget = block;
+	Handle target = createTextureHandle(width, height, levels, texture->layers, VK_FORMAT_R8G8B8A8_UNORM,
+	 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT |
+	 VK_IMAGE_USAGE_SAMPLED_BIT);
+	memoryTarget = UINT32_MAX;
+
+	if(textureMemories[lookupHandle(&textureTable, target)].memory == VK_NULL_HANDLE)
+	{
+		destroyHandle(&textureTable, target);
+		return 0;
+	}
 
-	vertices = realloc(vertices, vertexCount * vertexSize);
-	indices = realloc(indices, indexCount * indexSize);
+	VkImage image = lookupImage(target);
 
-	for(uint32_t index = 0; index < USHRT_MAX + 1; index++)
+	VkImageMemoryBarrier barriers[2] = {};
+	for(uint32_t index = 0; index < 2; index++)
 	{
-		if(hashMap[index].limit)
-		{
-			free(hashMap[index].indices);
-			free(hashMap[index].vertices);
-		}
+		barriers[index].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barriers[index].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[index].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[index].subresourceRange = (VkImageSubresourceRange){VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0,
+		 texture->layers};
 	}
 
-	free(hashMap);
+	barriers[0].image = lookupImage(source);
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[1].image = image;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	VkImageCopy *regions = allocateArena(levels * sizeof(VkImageCopy));
+	for(uint32_t level = 0; level < levels; level++)
+	{
+		regions[level] = (VkImageCopy){};
+		regions[level].srcSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, level, 0, texture->layers};
+		regions[level].dstSubresource = regions[level].srcSubresource;
+		regions[level].extent = (VkExtent3D){width >> level ? width >> level : 1, height >> level ? height >> level : 1, 1};
+	}
+
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+	 0, NULL, 0, NULL, 2, barriers);
+	vkCmdCopyImage(commandBuffer, barriers[0].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+	 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levels, regions);
+
+	// Slots that haven't picked up the new view yet keep sampling the source, so it goes back to being readable
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+	 0, NULL, 0, NULL, 2, barriers);
+
+	// Anything still holding the old handle now fails its lookup, and the image itself goes once its frames retire
+	destroyLater(&textureTable, source);
+	*texture->texture = target;
+
+	createResidentView(texture, levels);
+	return 1;
 }
 
-void createVertexBuffer()
+uint32_t defragmentMemory(VkCommandBuffer commandBuffer)
 {
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(vertexCount * vertexSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-	 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+	// Resident textures are the only allocations with a single owner that can patch every reference to them,
+	// everything else is either transient or baked into state that lives as long as the allocation
+	for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
+	{
+		ResidentTexture *texture = &residentTextures[textureIndex];
+		Allocation *memory = &textureMemories[lookupHandle(&textureTable, *texture->texture)];
+		uint32_t source = memory->block;
+		MemoryBlock *block = &memoryBlocks[source];
+
+		// A level set swapped in this frame is still being mipmapped, and the compute family hands it over only
+		// after the copy would have run
+		if(texture->committed == frameCount || !block->tree || block->used >= block->size * DEFRAG_SPARSE)
+			continue;
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, vertexCount * vertexSize, 0, &data);
-	memcpy(data, vertices, vertexCount * vertexSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+		// Only move into a busier block that already has room, emptying a sparse block to fill a new one wins nothing
+		uint32_t target = UINT32_MAX;
+		for(uint32_t index = 0; index < memoryBlockCount && target == UINT32_MAX; index++)
+			if(index != source && memoryBlocks[index].memory != VK_NULL_HANDLE && memoryBlocks[index].tree &&
+			 memoryBlocks[index].type == block->type && memoryBlocks[index].linear == block->linear &&
+			 memoryBlocks[index].used > block->used && memoryBlocks[index].tree[0] > memory->order)
+				target = index;
 
-	createBuffer(vertexCount * vertexSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
-	copyBuffer(stagingBuffer, vertexBuffer, vertexCount * vertexSize);
-	printlog(1, "Create Vertex Buffer: Size = %lu bytes", vertexCount * vertexSize);
+		if(target == UINT32_MAX)
+			continue;
 
-	vkFreeMemory(device, stagingBufferMemory, NULL);
-	vkDestroyBuffer(device, stagingBuffer, NULL);
-}
+		double fragmentation = memoryFragmentation();
+		if(!relocateResidentTexture(texture, target, commandBuffer))
+			continue;
 
-void createIndexBuffer()
-{
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(indexCount * indexSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
-	 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+		defragRelocations++;
+		printlog(1, "Relocate Texture: Binding %u from Block %u to %u, %.3f to %.3f Fragmentation", texture->binding,
+		 source, target, fragmentation, memoryFragmentation());
+		return 1;
+	}
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, indexCount * indexSize, 0, &data);
-	memcpy(data, indices, indexCount * indexSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	return 0;
+}
 
-	createBuffer(indexCount * indexSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-	 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
-	copyBuffer(stagingBuffer, indexBuffer, indexCount * indexSize);
-	printlog(1, "Create Index Buffer: Size = %lu bytes", indexCount * indexSize);
+void limitResidency(uint32_t heap, VkDeviceSize usage, VkDeviceSize budget)
+{
+	if(!(memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ||
+	 residencyBudget <= RESIDENCY_BUDGET / 8)
+		return;
 
-	vkFreeMemory(device, stagingBufferMemory, NULL);
-	vkDestroyBuffer(device, stagingBuffer, NULL);
+	residencyBudget /= 2;
+	printlog(1, "Limit Texture Residency: Heap %u at %.3f of %.3f MB, %.3f MB Budget", heap, usage / 1048576.0,
+	 budget / 1048576.0, residencyBudget / 1048576.0);
 }
 
-void createUniformBuffers()
+void createResidency()
 {
-	uniformBuffers = malloc(framebufferSize * sizeof(VkBuffer));
-	uniformBufferMemories = malloc(framebufferSize * sizeof(VkDeviceMemory));
+	residentTextures[0] = (ResidentTexture){&textureHandle, VK_IMAGE_VIEW_TYPE_2D, 1, &textureSampler,
+	 "textures/chalet.jpg", {virtualSources[0]}, virtualWidth, virtualWidth, mipLevels, 1, MIPMAP_KAISER,
+	 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	for(uint32_t level = RESIDENCY_REDUCTION + 1; level < virtualLevels; level++)
+		residentTextures[0].sources[level] = virtualSources[level];
+	residentCount = 1;
+
+	if(packedLayers)
+	{
+		residentTextures[1] = (ResidentTexture){&packedHandle, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 5, &packedSampler, NULL,
+		 {packedPixels}, ATLAS_SIZE, ATLAS_SIZE, ATLAS_LEVELS, packedLayers, MIPMAP_BOX,
+		 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+		residentCount = 2;
+	}
+
+	for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
+	{
+		ResidentTexture *texture = &residentTextures[textureIndex];
+		while(texture->minimum + 1 < texture->levels &&
+		 (texture->width > texture->height ? texture->width : texture->height) >> texture->minimum > RESIDENCY_MINIMUM)
+			texture->minimum++;
+	}
 
-	for(size_t uniformIndex = 0; uniformIndex < framebufferSize; uniformIndex++)
-		createBuffer(sizeof(UniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		 &uniformBuffers[uniformIndex], &uniformBufferMemories[uniformIndex]);
+	residencyBudget = RESIDENCY_BUDGET;
+	registerMemoryCallback(limitResidency);
 
-	printlog(1, "Create Uniform Buffers");
+	printlog(1, "Create Texture Residency: %u Textures, %.3f MB Budget, %s", residentCount,
+	 residencyBudget / 1048576.0, residency ? "Feedback" : "Disabled");
 }
 
-void createDescriptorPool()
+uint32_t distanceLevel(uint32_t textureIndex)
 {
-	VkDescriptorPoolSize uniformBufferSize = {};
-	uniformBufferSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	uniformBufferSize.descriptorCount = framebufferSize;
+	ResidentTexture *texture = &residentTextures[textureIndex];
+	float distance = INFINITY;
 
-	VkDescriptorPoolSize imageSamplerSize = {};
-	imageSamplerSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	imageSamplerSize.descriptorCount = framebufferSize;
+	for(uint32_t meshIndex = 0; meshIndex < meshTable.count; meshIndex++)
+	{
+		if(meshes[meshIndex].state != MESH_READY || meshes[meshIndex].mode != (textureIndex ? 2 : 0))
+			continue;
 
-	VkDescriptorPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.maxSets = framebufferSize;
-	poolInfo.poolSizeCount = 2;
-	poolInfo.pPoolSizes = (VkDescriptorPoolSize[]){uniformBufferSize, imageSamplerSize};
+		float *origin = meshes[meshIndex].origin;
+		distance = fminf(distance, sqrtf((origin[0] - position[0]) * (origin[0] - position[0]) +
+		 (origin[1] - position[1]) * (origin[1] - position[1]) + (origin[2] - position[2]) * (origin[2] - position[2])));
+	}
 
-	printlog(vkCreateDescriptorPool(device, &poolInfo, NULL, &descriptorPool) == VK_SUCCESS,
-	 "Create Descriptor Pool");
+	if(isinf(distance))
+		return texture->levels - 1;
+
+	float footprint = 2.0f * distance / height;
+	float texel = RESIDENCY_EXTENT / (texture->width > texture->height ? texture->width : texture->height);
+	uint32_t level = footprint > texel ? floorf(log2f(footprint / texel)) : 0;
+	return level < texture->levels - 1 ? level : texture->levels - 1;
 }
 
-void createDescriptorSets()
+void updateResidency(uint32_t frame)
 {
-	VkDescriptorSetLayout *layouts = malloc(framebufferSize * sizeof(VkDescriptorSetLayout));
-	for(uint32_t layoutIndex = 0; layoutIndex < framebufferSize; layoutIndex++)
-		layouts[layoutIndex] = descriptorSetLayout;
-
-	VkDescriptorSetAllocateInfo descriptorSetInfo = {};
-	descriptorSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	descriptorSetInfo.descriptorPool = descriptorPool;
-	descriptorSetInfo.descriptorSetCount = framebufferSize;
-	descriptorSetInfo.pSetLayouts = layouts;
+	uint32_t base = feedbackExtents[frame].width * feedbackExtents[frame].height, targets[RESIDENCY_TEXTURES], desired[RESIDENCY_TEXTURES];
+	VkDeviceSize total = 0, resident = 0, distance = 0;
 
-	descriptorSets = malloc(framebufferSize * sizeof(VkDescriptorSet));
-	printlog(vkAllocateDescriptorSets(device, &descriptorSetInfo, descriptorSets) == VK_SUCCESS,
-	 "Allocate Descriptor Sets");
-	free(layouts);
+	for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
+		if(residentTextures[textureIndex].pending && transferComplete(residentTextures[textureIndex].pendingSerial))
+			commitResidentTexture(&residentTextures[textureIndex]);
 
-	for(uint32_t layoutIndex = 0; layoutIndex < framebufferSize; layoutIndex++)
+	for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
 	{
-		VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = uniformBuffers[layoutIndex];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
+		ResidentTexture *texture = &residentTextures[textureIndex];
+		uint32_t value = feedbackData[frame][base + 2 * textureIndex];
+		texture->requested = value && RESIDENCY_LEVELS - value < texture->levels ?
+		 RESIDENCY_LEVELS - value : texture->levels - 1;
+		texture->coverage = feedbackData[frame][base + 2 * textureIndex + 1];
+
+		desired[textureIndex] = !residency ? 0 : texture->requested < texture->minimum ?
+		 texture->requested : texture->minimum;
+		targets[textureIndex] = residency ? texture->minimum : 0;
+		total += residentSize(texture, targets[textureIndex]);
+		resident += residentSize(texture, texture->resident);
+		distance += residentSize(texture, distanceLevel(textureIndex));
+	}
 
-		VkDescriptorImageInfo imageInfo = {};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = textureView;
-		imageInfo.sampler = textureSampler;
+	while(residency)
+	{
+		int32_t best = -1;
+		double bestPriority = 0.0;
 
-		VkWriteDescriptorSet bufferDescriptorWrite = {};
-		bufferDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		bufferDescriptorWrite.dstSet = descriptorSets[layoutIndex];
-		bufferDescriptorWrite.dstBinding = 0;
-		bufferDescriptorWrite.dstArrayElement = 0;
-		bufferDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		bufferDescriptorWrite.descriptorCount = 1;
-		bufferDescriptorWrite.pBufferInfo = &bufferInfo;
+		for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
+		{
+			ResidentTexture *texture = &residentTextures[textureIndex];
+			if(targets[textureIndex] <= desired[textureIndex])
+				continue;
 
-		VkWriteDescriptorSet samplerDescriptorWrite = {};
-		samplerDescriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		samplerDescriptorWrite.dstSet = descriptorSets[layoutIndex];
-		samplerDescriptorWrite.dstBinding = 1;
-		samplerDescriptorWrite.dstArrayElement = 0;
-		samplerDescriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		samplerDescriptorWrite.descriptorCount = 1;
-		samplerDescriptorWrite.pImageInfo = &imageInfo;
+			VkDeviceSize cost = residentSize(texture, targets[textureIndex] - 1) -
+			 residentSize(texture, targets[textureIndex]);
+			double priority = (texture->coverage + 1.0) / cost;
 
-		vkUpdateDescriptorSets(device, 2, (VkWriteDescriptorSet[])
-		 {bufferDescriptorWrite, samplerDescriptorWrite}, 0, NULL);
-	}
+			if(total + cost <= residencyBudget && priority > bestPriority)
+			{
+				best = textureIndex;
+				bestPriority = priority;
+			}
+		}
 
-	printlog(1, "Update Descriptor Sets");
-}
+		if(best == -1)
+			break;
 
-void createCommandBuffers()
-{
-	VkCommandBufferAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocateInfo.commandPool = commandPool;
-	allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocateInfo.commandBufferCount = framebufferSize;
+		total += residentSize(&residentTextures[best], targets[best] - 1) -
+		 residentSize(&residentTextures[best], targets[best]);
+		targets[best]--;
+	}
 
-	commandBuffers = malloc(framebufferSize * sizeof(VkCommandBuffer));
-	printlog(vkAllocateCommandBuffers(device, &allocateInfo, commandBuffers) == VK_SUCCESS,
-	 "Allocate Command Buffers");
+	residencyFrames++;
+	residencyResident += resident;
+	residencyDistance += distance;
 
-	for(uint32_t commandIndex = 0; commandIndex < framebufferSize; commandIndex++)
+	for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
 	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		ResidentTexture *texture = &residentTextures[textureIndex];
 
-		VkClearValue clearValues[2] = {};
-		clearValues[0].color.float32[0] = 0.0f;
-		clearValues[0].color.float32[1] = 0.0f;
-		clearValues[0].color.float32[2] = 0.0f;
-		clearValues[0].color.float32[3] = 1.0f;
-		clearValues[1].depthStencil.depth = 1.0f;
-		clearValues[1].depthStencil.stencil = 0;
+		if(targets[textureIndex] > texture->resident)
+			texture->frames++;
+		else
+			texture->frames = 0;
 
-		VkRenderPassBeginInfo renderPassBeginInfo = {};
-		renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassBeginInfo.renderPass = renderPass;
-		renderPassBeginInfo.framebuffer = swapchainFramebuffers[commandIndex];
-		renderPassBeginInfo.renderArea.offset = (VkOffset2D){};
-		renderPassBeginInfo.renderArea.extent = swapchainExtent;
-		renderPassBeginInfo.clearValueCount = 2;
-		renderPassBeginInfo.pClearValues = clearValues;
+		if(texture->pending)
+			continue;
 
-		printlog(vkBeginCommandBuffer(commandBuffers[commandIndex], &beginInfo) == VK_SUCCESS, NULL);
-		vkCmdBeginRenderPass(commandBuffers[commandIndex], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-		vkCmdBindPipeline(commandBuffers[commandIndex], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-		vkCmdBindDescriptorSets(commandBuffers[commandIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-		 pipelineLayout, 0, 1, &descriptorSets[commandIndex], 0, NULL);
-		vkCmdBindVertexBuffers(commandBuffers[commandIndex], 0, 1, &vertexBuffer, (VkDeviceSize[]){0});
-		vkCmdBindIndexBuffer(commandBuffers[commandIndex], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(commandBuffers[commandIndex], indexCount, 1, 0, 0, 0);
-		vkCmdEndRenderPass(commandBuffers[commandIndex]);
-		printlog(vkEndCommandBuffer(commandBuffers[commandIndex]) == VK_SUCCESS, NULL);
+		if(targets[textureIndex] < texture->resident || (targets[textureIndex] > texture->resident &&
+		 (resident > residencyBudget || texture->frames >= RESIDENCY_DELAY)))
+		{
+			texture->frames = 0;
+			loadResidentTexture(texture, targets[textureIndex]);
+			break;
+		}
 	}
+}
+
+void reportResidency()
+{
+	printlog(1, "Texture Residency: %s, %lu Loads, %lu Evictions, %.3f MB Uploaded", residency ? "Feedback" : "Disabled",
+	 residencyLoads, residencyEvictions, residencyUploaded / 1048576.0);
 
-	printlog(1, "Record Commands");
+	if(residencyFrames)
+		printlog(1, "Texture Residency: %.3f MB Average Resident, %.3f MB with Distance Streaming, %.3f MB Saved",
+		 residencyResident / 1048576.0 / residencyFrames, residencyDistance / 1048576.0 / residencyFrames,
+		 ((double)residencyDistance - residencyResident) / 1048576.0 / residencyFrames);
 }
 
 void createSyncObjects()
 {
-	framebufferLimit = 2;
-
-	imageAvailable = malloc(framebufferLimit * sizeof(VkSemaphore));
-	renderFinished = malloc(framebufferLimit * sizeof(VkSemaphore));
-	frameFences = malloc(framebufferLimit * sizeof(VkFence));
+	imageAvailable = allocateHost(HOST_DEVICE, framebufferLimit * sizeof(VkSemaphore));
+	renderFinished = allocateHost(HOST_DEVICE, framebufferLimit * sizeof(VkSemaphore));
+	frameValues = allocateHostZeroed(HOST_DEVICE, framebufferLimit, sizeof(uint64_t));
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
+	// Presentation only takes binary semaphores, so just the acquire and present pair stay per slot
 	for(uint32_t syncIndex = 0; syncIndex < framebufferLimit; syncIndex++)
 	{
 		vkCreateSemaphore(device, &semaphoreInfo, NULL, &imageAvailable[syncIndex]);
 		vkCreateSemaphore(device, &semaphoreInfo, NULL, &renderFinished[syncIndex]);
-		vkCreateFence(device, &fenceInfo, NULL, &frameFences[syncIndex]);
 	}
 
-	printlog(1, "Create Syncronization Objects");
+	// Frame n signals n + 1 when it retires, which both the frame slots and the swapchain images wait on
+	VkSemaphoreTypeCreateInfo timelineInfo = {};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineInfo.initialValue = 0;
+
+	semaphoreInfo.pNext = &timelineInfo;
+	printlog(vkCreateSemaphore(device, &semaphoreInfo, NULL, &frameTimeline) == VK_SUCCESS, NULL);
+
+	// Latency pacing needs the GPU time of a frame, which the graphics queue may be able to timestamp
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	timestampPeriod = deviceProperties.limits.timestampPeriod;
+
+	uint32_t queueCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, NULL);
+	VkQueueFamilyProperties *queueProperties = allocateHost(HOST_DEVICE, queueCount * sizeof(VkQueueFamilyProperties));
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, queueProperties);
+	frameTimestamps = lowLatency && queueProperties[graphicsIndex].timestampValidBits;
+	freeHost(queueProperties);
+
+	if(frameTimestamps)
+	{
+		VkQueryPoolCreateInfo queryInfo = {};
+		queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryInfo.queryCount = 2 * framebufferLimit;
+		printlog(vkCreateQueryPool(device, &queryInfo, NULL, &frameQueries) == VK_SUCCESS, NULL);
+	}
+
+	printlog(1, "Create Syncronization Objects: %u Frames in Flight%s", framebufferLimit,
+	 lowLatency ? presentWait ? ", Low Latency with Present Wait" : ", Low Latency" : "");
 }
 
-void recreatePipeline()
+void sleepUntil(double target)
 {
-	vkDeviceWaitIdle(device);
-	cleanupPipeline();
+	double remaining = target - measureTime();
+	if(remaining > 0.0)
+		nanosleep(&(struct timespec){(time_t)remaining, (long)((remaining - (time_t)remaining) * 1e9)}, NULL);
+}
 
-	createGraphicsPipeline();
-	createCommandBuffers();
+void paceFrame()
+{
+	// Aim for the submission to land just as the GPU frees up, or just in time for the next refresh once a
+	// presented frame has shown how the display is ticking
+	double target = latencySubmit + latencyGpu - latencyCpu - LATENCY_MARGIN;
+	if(presentWait && presentLast && waitForPresent(device, swapchain, presentLast, PRESENT_TIMEOUT) == VK_SUCCESS)
+	{
+		double displayed = measureTime();
+		latencyDisplayTotal += displayed - latencySubmit;
+		latencyDisplays++;
+
+		if(latencyDisplayed)
+			latencyInterval += LATENCY_SMOOTHING * (displayed - latencyDisplayed - latencyInterval);
+		latencyDisplayed = displayed;
+		target = displayed + latencyInterval - latencyGpu - latencyCpu - LATENCY_MARGIN;
+	}
+
+	sleepUntil(target);
+	waitTimeline(frameTimeline, frameCount);
+
+	// Without timestamps the time the frame was seen to retire stands in, which can only overestimate
+	uint64_t timestamps[2];
+	uint32_t slot = (frameCount + framebufferLimit - 1) % framebufferLimit;
+	if(frameTimestamps && frameCount && vkGetQueryPoolResults(device, frameQueries, 2 * slot, 2, sizeof(timestamps),
+	 timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+		latencyGpu += LATENCY_SMOOTHING * ((timestamps[1] - timestamps[0]) * timestampPeriod / 1e9 - latencyGpu);
+	else if(frameCount)
+		latencyGpu += LATENCY_SMOOTHING * (measureTime() - latencySubmit - latencyGpu);
+
+	latencyWake = measureTime();
+}
+
+void reportLatency()
+{
+	printlog(1, "Input Latency: %.3f ms Input to Submit, %.3f ms Submit to Display", latencyFrames ?
+	 1000.0 * latencyInputTotal / latencyFrames : 0.0, latencyDisplays ? 1000.0 * latencyDisplayTotal /
+	 latencyDisplays : 0.0);
+	if(lowLatency)
+		printlog(1, "Latency Pacing: %.3f ms GPU, %.3f ms CPU, %.3f ms Refresh Estimates", 1000.0 * latencyGpu,
+		 1000.0 * latencyCpu, 1000.0 * latencyInterval);
+}
+
+void updateRenderState()
+{
+	// Every variant already exists, so a toggle only picks another one and re-records the cached partitions
+	finishGraphicsPipelines();
+	graphicsPipeline = pipelineVariants[pipelineVariant(cullMode, fillMode, depthMode)];
+	invalidatePartitions();
 }
 
 void recreateSwapchain()
@@ -1583,49 +6257,95 @@ void recreateSwapchain()
 		glfwWaitEvents();
 		glfwGetFramebufferSize(window, &width, &height);
 	}
-	vkDeviceWaitIdle(device);
+	double start = measureTime();
 
-	cleanupSwapchain();
+	// Only what is sized to the window is replaced, and the old objects are released once the frames that may
+	// still use them retire instead of waiting for the device to idle
+	retireSwapchain();
+	freeHost(swapchainDetails.presentModes);
+	freeHost(swapchainDetails.surfaceFormats);
 	swapchainDetails = generateSwapchainDetails(physicalDevice);
 
+	VkFormat previousFormat = swapchainFormat;
 	createSwapchain();
-	createRenderPass();
-	createGraphicsPipeline();
+	if(swapchainFormat != previousFormat)
+	{
+		vkDeviceWaitIdle(device);
+		cleanupGraphicsPipelines();
+		vkDestroyRenderPass(device, renderPass, NULL);
+		createRenderPass();
+		createGraphicsPipeline();
+		finishGraphicsPipelines();
+	}
 	createColorBuffer();
 	createDepthBuffer();
+	bindAttachments();
 	createFramebuffers();
-	createUniformBuffers();
-	createDescriptorPool();
-	createDescriptorSets();
-	createCommandBuffers();
+
+	// Each slot swaps its feedback buffer for one of the new size once it retires, skipping that readback, and
+	// until then the slot keeps describing its old buffer to the shader
+	feedbackWidth = (swapchainExtent.width + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+	feedbackHeight = (swapchainExtent.height + FEEDBACK_SCALE - 1) / FEEDBACK_SCALE;
+	feedbackStale = (1u << framebufferLimit) - 1;
+	presentLast = 0;
+	invalidatePartitions();
+
+	printlog(1, "Recreate Swapchain: %u x %u, %.3f ms, %u Retiring", swapchainExtent.width, swapchainExtent.height,
+	 1000.0 * (measureTime() - start), retiredCount);
 }
 
 void setup()
 {
+	double start = measureTime();
+	createHostArena(HOST_FRAME, HOST_ARENA);
 	glfwInit();
 	createInstance();
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	createMemory();
+	createHandleTables();
+	createPipelineCache();
 	createSwapchain();
 	createRenderPass();
 	createDescriptorSetLayout();
 	createShaderModules();
 	createGraphicsPipeline();
-	createCommandPool();
+	createUpload();
+	createMipmapPipeline();
 	createColorBuffer();
 	createDepthBuffer();
+	bindAttachments();
 	createFramebuffers();
 	createTextureImage();
 	createTextureSampler();
+	createVirtualTexture();
 	createObjectModels();
-	createVertexBuffer();
-	createIndexBuffer();
-	createUniformBuffers();
+	createPackedTexture();
+	generateMipmaps();
+	createResidency();
+	if(benchmark)
+	{
+		benchmarkMipmaps();
+		benchmarkReducedJpeg();
+		benchmarkUpload();
+	}
+	createGeometry();
+	createRingBuffer();
+	createObjectBuffers();
+	createFeedbackBuffers();
 	createDescriptorPool();
 	createDescriptorSets();
-	createCommandBuffers();
 	createSyncObjects();
+	createRecording();
+	createCompute();
+	createVirtualFrames();
+	submitUpload();
+	finishGraphicsPipelines();
+	printlog(1, "Setup: %.3f ms, %lu Upload Batches, %lu Waits", 1000.0 * (measureTime() - start), uploadSubmits,
+	 uploadWaits);
+	printlog(1, "Pipeline Compilation: %.3f ms, %s Cache", 1000.0 * pipelineTime,
+	 pipelineCacheLoaded ? "Warm" : "Cold");
 }
 
 void directionVector(float v[], float t[])
@@ -1828,7 +6548,23 @@ void perspectiveMatrix(float m[], float fov, float asp, float n, float f)
 	memcpy(m, k, sizeof(k));
 }
 
-void updateUniformBuffer(int index)
+void updateObjects(uint32_t frame)
+{
+	// The camera is written into its reserved slot last, right before the frame is submitted
+	resetRing(frame);
+	recordOffset = allocateRing(sizeof(UniformBufferObject), &uniformData);
+
+	if(meshTable.count > objectLimits[frame])
+		growObjectBuffer(frame);
+
+	// Objects sit at their mesh slot, so cached partitions stay valid, and free slots are never drawn
+	ObjectBufferObject *objects = lookupBufferMemory(objectBuffers[frame])->mapped;
+	for(uint32_t meshIndex = 0; meshIndex < meshTable.count; meshIndex++)
+		if(meshes[meshIndex].state == MESH_READY)
+			objects[meshIndex] = (ObjectBufferObject){meshes[meshIndex].mode, meshes[meshIndex].layer};
+}
+
+void updateUniformBuffer(uint32_t frame)
 {
 	UniformBufferObject ubo = {};
 	float center[4], left[4], direction[4];
@@ -1844,6 +6580,15 @@ void updateUniformBuffer(int index)
 		ready = 1;
 	}
 
+	if(benchmark)
+	{
+		float angle = 2 * M_PI * frameCount / BENCHMARK_FRAMES, radius = 6.0f - 4.0f * frameCount / BENCHMARK_FRAMES;
+		positionVector(position, (float[]){radius * cosf(angle), radius * sinf(angle), -0.5f - 1.5f * fabsf(sinf(angle))});
+		directionVector(forward, (float[]){-position[0], -position[1], -position[2] - 0.5f});
+		normalize(forward);
+		moveX = moveY = 0;
+	}
+
 	long timediff = 1e6L * (timespec.tv_sec - timeorig.tv_sec) + (timespec.tv_nsec - timeorig.tv_nsec) / 1e3L;
 	float delta = M_PI * timediff / (4e6L * sqrtf(fmaxf(1, (keyW || keyS) + (keyA || keyD) + (keyR || keyF))));
 	timeorig = timespec;
@@ -1873,53 +6618,165 @@ void updateUniformBuffer(int index)
 	cameraMatrix(ubo.view, position, center, up);
 	perspectiveMatrix(ubo.proj, M_PI / 2, (float)width / (float)height, 0.01f, 100.0f);
 
-	void *data;
-	vkMapMemory(device, uniformBufferMemories[index], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(device, uniformBufferMemories[index]);
+	ubo.feedback[0] = feedbackExtents[frame].width;
+	ubo.feedback[1] = frameCount * 37 % (FEEDBACK_SCALE * FEEDBACK_SCALE);
+	ubo.feedback[2] = virtualPages;
+	ubo.feedback[3] = virtualLevels;
+	ubo.residency[0] = residentTextures[0].resident;
+	ubo.residency[1] = residentTextures[1].resident;
+	ubo.residency[2] = residency;
+	ubo.residency[3] = feedbackExtents[frame].width * feedbackExtents[frame].height;
+	memcpy(uniformData, &ubo, sizeof(ubo));
+}
+
+void reportHost()
+{
+	for(uint32_t tag = 0; tag < HOST_TAGS; tag++)
+		printlog(1, "Host Memory %s: %.3f MB Live, %.3f MB Peak, %lu Live of %lu Allocations", hostNames[tag],
+		 hostStatistics[tag].live / 1048576.0, hostStatistics[tag].peak / 1048576.0, hostStatistics[tag].count,
+		 hostStatistics[tag].total);
+	printlog(1, "Frame Arena: %.3f KB Peak of %.3f KB", hostArenaPeak / 1024.0, hostArenaSize / 1024.0);
+}
+
+void reportHostLeaks()
+{
+	uint64_t leaks = 0;
+	for(uint32_t tag = 0; tag < HOST_TAGS; tag++)
+	{
+		if(!hostStatistics[tag].count)
+			continue;
+
+		printlog(1, "Host Leak %s: %lu Allocations, %.3f KB", hostNames[tag], hostStatistics[tag].count,
+		 hostStatistics[tag].live / 1024.0);
+		leaks += hostStatistics[tag].count;
+	}
+
+	printlog(1, "Host Leaks: %lu Allocations", leaks);
 }
 
 void draw()
 {
 	time_t currentTime = 0;
-	uint32_t currentFrame = 0, frameCount = 0, checkPoint = 0;
-	printlog(1, "Begin Drawing");
+	uint32_t currentFrame = 0, checkPoint = 0;
+	double startTime = measureTime();
+	printlog(1, "Begin Drawing%s", benchmark ? ": Benchmark Path" : "");
 
 	while(!glfwWindowShouldClose(window))
 	{
-		glfwPollEvents();
-		vkWaitForFences(device, 1, &frameFences[currentFrame], VK_TRUE, ULONG_MAX);
+		if(!lowLatency)
+		{
+			glfwPollEvents();
+			latencyInput = measureTime();
+		}
+		waitTimeline(frameTimeline, frameValues[currentFrame]);
+		if(lowLatency)
+			paceFrame();
+		resetHostArena();
+		releaseSwapchains(timelineValue(frameTimeline));
+		beginComputeFrame(currentFrame);
+		if(feedbackStale & 1u << currentFrame)
+			resizeFeedback(currentFrame);
+		else if(frameValues[currentFrame])
+		{
+			requestVirtualPages(currentFrame);
+			updateResidency(currentFrame);
+		}
+		updateResidentViews(currentFrame);
+		if(frameCount % MEMORY_INTERVAL == 0)
+			updateMemoryBudget();
+		collectGeometry();
+		collectHandles(0);
+		collectUploads();
+		if(churn && frameCount < CHURN_FRAMES)
+			churnGeometry();
+
+		// Some platforms never report a resized surface as out of date, so the window size is checked directly
+		if((uint32_t)width != swapchainExtent.width || (uint32_t)height != swapchainExtent.height)
+			recreateSwapchain();
 
+		// A suboptimal image is still acquired and signals its semaphore, so it is presented before recreating
 		uint32_t imageIndex;
 		VkResult acquireResult = vkAcquireNextImageKHR(device, swapchain, ULONG_MAX,
 		 imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
-		if(acquireResult == VK_SUBOPTIMAL_KHR || acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+		if(acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
 		{
 			recreateSwapchain();
 			continue;
 		}
 
-		clock_gettime(CLOCK_REALTIME, &timespec);
-		updateUniformBuffer(imageIndex);
+		// Another slot may still be rendering into the image if the swapchain hands it back early
+		waitTimeline(frameTimeline, imageValues[imageIndex]);
+
+		updateObjects(currentFrame);
+		VkCommandBuffer frameCommand = recordCommandBuffers(currentFrame, imageIndex);
 
-		VkSemaphore waitSemaphores[] = {imageAvailable[currentFrame]};
-		VkSemaphore signalSemaphores[] = {renderFinished[currentFrame]};
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(virtualCommands[currentFrame], &beginInfo);
+		uint32_t uploadCount = uploadVirtualPages(virtualCommands[currentFrame], currentFrame,
+		 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		uploadCount += defragmentGeometry(virtualCommands[currentFrame]);
+		if(frameCount % MEMORY_INTERVAL == 0)
+			uploadCount += defragmentMemory(virtualCommands[currentFrame]);
+		uploadCount += uploadGeometry(virtualCommands[currentFrame], currentFrame);
+		uploadCount += acquireCompute(virtualCommands[currentFrame]);
+		vkEndCommandBuffer(virtualCommands[currentFrame]);
+
+		// The compute stage goes out first so it can run while the previous frame is still rasterizing
+		uint64_t computeValue = submitCompute();
+		VkSemaphore waitSemaphores[] = {imageAvailable[currentFrame], computeTimeline};
+		VkSemaphore signalSemaphores[] = {renderFinished[currentFrame], frameTimeline};
+		uint64_t frameValue = (uint64_t)frameCount + 1;
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = computeValue ? 2 : 1;
+		timelineInfo.pWaitSemaphoreValues = (uint64_t[]){0, computeValue};
+		timelineInfo.signalSemaphoreValueCount = 2;
+		timelineInfo.pSignalSemaphoreValues = (uint64_t[]){0, frameValue};
 
 		VkSubmitInfo submitInfo = {};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = computeValue ? 2 : 1;
 		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.signalSemaphoreCount = 2;
 		submitInfo.pSignalSemaphores = signalSemaphores;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
-		submitInfo.pWaitDstStageMask = (VkPipelineStageFlags[]){VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+		submitInfo.commandBufferCount = uploadCount ? 2 : 1;
+		submitInfo.pCommandBuffers = uploadCount ? (VkCommandBuffer[]){virtualCommands[currentFrame],
+		 frameCommand} : &frameCommand;
+		submitInfo.pWaitDstStageMask = (VkPipelineStageFlags[]){VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT};
+
+		// Uploads recorded this frame are submitted ahead of it on the same queue, so their barriers order them
+		submitUpload();
+
+		// In latency mode input is sampled after everything but the submission, so the camera is as fresh as it gets
+		if(lowLatency)
+		{
+			glfwPollEvents();
+			latencyInput = measureTime();
+		}
+		clock_gettime(CLOCK_REALTIME, &timespec);
+		updateUniformBuffer(currentFrame);
+
+		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+		frameValues[currentFrame] = imageValues[imageIndex] = frameValue;
+		latencySubmit = measureTime();
+		latencyInputTotal += latencySubmit - latencyInput;
+		latencyCpu += LATENCY_SMOOTHING * (latencySubmit - latencyWake - latencyCpu);
+		latencyFrames++;
 
-		vkResetFences(device, 1, &frameFences[currentFrame]);
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, frameFences[currentFrame]);
+		VkPresentIdKHR presentId = {};
+		presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentId.swapchainCount = 1;
+		presentId.pPresentIds = &frameValue;
 
 		VkPresentInfoKHR presentInfo = {};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+		presentInfo.pNext = presentWait ? &presentId : NULL;
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.waitSemaphoreCount = 1;
 		presentInfo.pWaitSemaphores = signalSemaphores;
@@ -1927,6 +6784,7 @@ void draw()
 		presentInfo.pSwapchains = (VkSwapchainKHR[]){swapchain};
 
 		VkResult presentResult = vkQueuePresentKHR(presentQueue, &presentInfo);
+		presentLast = presentWait ? frameValue : 0;
 		if(presentResult == VK_SUBOPTIMAL_KHR || presentResult == VK_ERROR_OUT_OF_DATE_KHR)
 			recreateSwapchain();
 
@@ -1939,54 +6797,86 @@ void draw()
 			currentTime = timespec.tv_sec;
 			checkPoint = frameCount;
 		}
+
+		if((benchmark && frameCount == BENCHMARK_FRAMES) || (churn && frameCount == 2 * CHURN_FRAMES))
+			glfwSetWindowShouldClose(window, 1);
 	}
 
-	printlog(1, "Finish Drawing");
+	double elapsed = measureTime() - startTime;
+	printlog(1, "Finish Drawing: %u Frames in %.3f s, %.3f ms per Frame", frameCount, elapsed,
+	 frameCount ? 1e3 * elapsed / frameCount : 0.0);
+	reportVirtualTexture(elapsed);
+	reportResidency();
+	reportGeometry();
+	reportUpload();
+	reportCompute();
+	reportRecording();
+	reportLatency();
+	reportMemory();
+	reportHost();
 	vkDeviceWaitIdle(device);
 }
 
-void cleanupPipeline()
+void retireSwapchain()
 {
-	vkFreeCommandBuffers(device, commandPool, framebufferSize, commandBuffers);
-	vkDestroyPipeline(device, graphicsPipeline, NULL);
-	vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+	// Frames already submitted may still present from the old images, so they are kept until a full ring of
+	// frames on the new swapchain has finished
+	if(retiredCount == SWAPCHAIN_RETIRED)
+	{
+		// Resizing faster than frames retire falls back to waiting for everything submitted so far
+		uint64_t submitted = 0;
+		for(uint32_t frameIndex = 0; frameIndex < framebufferLimit; frameIndex++)
+			submitted = frameValues[frameIndex] > submitted ? frameValues[frameIndex] : submitted;
+		waitTimeline(frameTimeline, submitted);
+		releaseSwapchains(retiredSwapchains[0].value);
+	}
 
-	free(commandBuffers);
+	RetiredSwapchain *retired = &retiredSwapchains[retiredCount++];
+	retired->swapchain = swapchain;
+	retired->views = swapchainViews;
+	retired->framebuffers = swapchainFramebuffers;
+	retired->count = framebufferSize;
+	retired->colorImage = colorImage;
+	retired->colorView = colorView;
+	retired->depthImage = depthImage;
+	retired->depthView = depthView;
+	retired->memory = (Allocation){};
+	retired->value = (uint64_t)frameCount + 1 + framebufferLimit;
+
+	freeHost(swapchainImages);
+	freeHost(imageValues);
 }
 
-void cleanupSwapchain()
+void releaseSwapchains(uint64_t completed)
 {
-	vkDestroyImageView(device, depthView, NULL);
-	vkDestroyImage(device, depthImage, NULL);
-	vkFreeMemory(device, depthMemory, NULL);
-	vkDestroyImageView(device, colorView, NULL);
-	vkDestroyImage(device, colorImage, NULL);
-	vkFreeMemory(device, colorMemory, NULL);
-	for(uint32_t framebufferIndex = 0; framebufferIndex < framebufferSize; framebufferIndex++)
-		vkDestroyFramebuffer(device, swapchainFramebuffers[framebufferIndex], NULL);
-	vkFreeCommandBuffers(device, commandPool, framebufferSize, commandBuffers);
-	vkDestroyPipeline(device, graphicsPipeline, NULL);
-	vkDestroyPipelineLayout(device, pipelineLayout, NULL);
-	vkDestroyRenderPass(device, renderPass, NULL);
-	for(uint32_t viewIndex = 0; viewIndex < framebufferSize; viewIndex++)
-		vkDestroyImageView(device, swapchainViews[viewIndex], NULL);
-	vkDestroySwapchainKHR(device, swapchain, NULL);
-	vkDestroyDescriptorPool(device, descriptorPool, NULL);
-	for(size_t uniformIndex = 0; uniformIndex < framebufferSize; uniformIndex++)
+	uint32_t kept = 0;
+	for(uint32_t retiredIndex = 0; retiredIndex < retiredCount; retiredIndex++)
 	{
-		vkDestroyBuffer(device, uniformBuffers[uniformIndex], NULL);
-		vkFreeMemory(device, uniformBufferMemories[uniformIndex], NULL);
-	}
+		RetiredSwapchain *retired = &retiredSwapchains[retiredIndex];
+		if(retired->value > completed)
+		{
+			retiredSwapchains[kept++] = *retired;
+			continue;
+		}
+
+		vkDestroyImageView(device, retired->depthView, NULL);
+		vkDestroyImage(device, retired->depthImage, NULL);
+		vkDestroyImageView(device, retired->colorView, NULL);
+		vkDestroyImage(device, retired->colorImage, NULL);
+		for(uint32_t imageIndex = 0; imageIndex < retired->count; imageIndex++)
+		{
+			if(retired->framebuffers)
+				vkDestroyFramebuffer(device, retired->framebuffers[imageIndex], NULL);
+			vkDestroyImageView(device, retired->views[imageIndex], NULL);
+		}
+		vkDestroySwapchainKHR(device, retired->swapchain, NULL);
+		if(retired->memory.memory != VK_NULL_HANDLE)
+			freeMemory(&retired->memory);
 
-	free(swapchainDetails.presentModes);
-	free(swapchainDetails.surfaceFormats);
-	free(swapchainViews);
-	free(swapchainImages);
-	free(swapchainFramebuffers);
-	free(uniformBuffers);
-	free(uniformBufferMemories);
-	free(descriptorSets);
-	free(commandBuffers);
+		freeHost(retired->views);
+		freeHost(retired->framebuffers);
+	}
+	retiredCount = kept;
 }
 
 void clean()
@@ -1994,36 +6884,45 @@ void clean()
 	printlog(1, "Start Cleaning");
 	for(uint32_t syncIndex = 0; syncIndex < framebufferLimit; syncIndex++)
 	{
-		vkDestroyFence(device, frameFences[syncIndex], NULL);
 		vkDestroySemaphore(device, renderFinished[syncIndex], NULL);
 		vkDestroySemaphore(device, imageAvailable[syncIndex], NULL);
 	}
+	vkDestroySemaphore(device, frameTimeline, NULL);
+	if(frameTimestamps)
+		vkDestroyQueryPool(device, frameQueries, NULL);
+	cleanupUpload();
+	cleanupCompute();
+	for(uint32_t textureIndex = 0; textureIndex < residentCount; textureIndex++)
+		if(residentTextures[textureIndex].pending)
+			destroyHandle(&textureTable, residentTextures[textureIndex].pending);
+	collectHandles(1);
+	cleanupVirtualTexture();
 	vkDestroyDescriptorPool(device, descriptorPool, NULL);
-	for(size_t uniformIndex = 0; uniformIndex < framebufferSize; uniformIndex++)
-	{
-		vkDestroyBuffer(device, uniformBuffers[uniformIndex], NULL);
-		vkFreeMemory(device, uniformBufferMemories[uniformIndex], NULL);
-	}
-	vkDestroyBuffer(device, indexBuffer, NULL);
-	vkFreeMemory(device, indexBufferMemory, NULL);
-	vkDestroyBuffer(device, vertexBuffer, NULL);
-	vkFreeMemory(device, vertexBufferMemory, NULL);
-	vkDestroySampler(device, textureSampler, NULL);
-	vkDestroyImageView(device, textureView, NULL);
-	vkDestroyImage(device, textureImage, NULL);
-	vkFreeMemory(device, textureMemory, NULL);
+	destroyHandle(&bufferTable, ringBuffer);
+	for(uint32_t objectIndex = 0; objectIndex < framebufferLimit; objectIndex++)
+		destroyHandle(&bufferTable, objectBuffers[objectIndex]);
+	for(uint32_t feedbackIndex = 0; feedbackIndex < framebufferLimit; feedbackIndex++)
+		destroyHandle(&bufferTable, feedbackBuffers[feedbackIndex]);
+	cleanupGeometry();
+	destroyHandle(&textureTable, packedHandle);
+	destroyHandle(&samplerTable, packedSampler);
+	freeHost(packedPixels);
+	destroyHandle(&samplerTable, textureSampler);
+	destroyHandle(&samplerTable, mipmapSampler);
+	destroyHandle(&pipelineTable, mipmapPipeline);
+	vkDestroyDescriptorSetLayout(device, mipmapSetLayout, NULL);
+	vkDestroyShaderModule(device, mipmapShader, NULL);
+	destroyHandle(&textureTable, textureHandle);
+	releaseSwapchains(UINT64_MAX);
 	vkDestroyImageView(device, depthView, NULL);
 	vkDestroyImage(device, depthImage, NULL);
-	vkFreeMemory(device, depthMemory, NULL);
 	vkDestroyImageView(device, colorView, NULL);
 	vkDestroyImage(device, colorImage, NULL);
-	vkFreeMemory(device, colorMemory, NULL);
-	for(uint32_t framebufferIndex = 0; framebufferIndex < framebufferSize; framebufferIndex++)
+	freeMemory(&attachmentMemory);
+	for(uint32_t framebufferIndex = 0; swapchainFramebuffers && framebufferIndex < framebufferSize; framebufferIndex++)
 		vkDestroyFramebuffer(device, swapchainFramebuffers[framebufferIndex], NULL);
-	vkFreeCommandBuffers(device, commandPool, framebufferSize, commandBuffers);
-	vkDestroyCommandPool(device, commandPool, NULL);
-	vkDestroyPipeline(device, graphicsPipeline, NULL);
-	vkDestroyPipelineLayout(device, pipelineLayout, NULL);
+	cleanupRecording();
+	cleanupGraphicsPipelines();
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, NULL);
 	vkDestroyShaderModule(device, vertexShader, NULL);
 	vkDestroyShaderModule(device, fragmentShader, NULL);
@@ -2031,6 +6930,10 @@ void clean()
 	for(uint32_t viewIndex = 0; viewIndex < framebufferSize; viewIndex++)
 		vkDestroyImageView(device, swapchainViews[viewIndex], NULL);
 	vkDestroySwapchainKHR(device, swapchain, NULL);
+	cleanupHandleTables();
+	cleanupMemory();
+	storePipelineCache();
+	vkDestroyPipelineCache(device, pipelineCache, NULL);
 	vkDestroyDevice(device, NULL);
 	vkDestroySurfaceKHR(instance, surface, NULL);
 	glfwDestroyWindow(window);
@@ -2040,11 +6943,53 @@ void clean()
 		destroyMessenger(instance, messenger, NULL);
 	vkDestroyInstance(instance, NULL);
 	glfwTerminate();
+
+	freeHost(swapchainDetails.presentModes);
+	freeHost(swapchainDetails.surfaceFormats);
+	freeHost(swapchainViews);
+	freeHost(swapchainImages);
+	freeHost(imageValues);
+	freeHost(swapchainFramebuffers);
+	freeHost(feedbackBuffers);
+	freeHost(feedbackData);
+	freeHost(feedbackExtents);
+	freeHost(objectBuffers);
+	freeHost(objectLimits);
+	freeHost(descriptorSets);
+	freeHost(imageAvailable);
+	freeHost(renderFinished);
+	freeHost(frameValues);
+	destroyHostArena();
+	reportHostLeaks();
 	printlog(1, "End Cleaning");
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+	const char *presentNames[] = {"present=fifo", "present=relaxed", "present=mailbox", "present=immediate"};
+	VkPresentModeKHR presentModes[] = {VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+	 VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+
+	framebufferLimit = FRAMES_IN_FLIGHT;
+	presentRequest = VK_PRESENT_MODE_MAILBOX_KHR;
+	for(int argument = 1; argument < argc; argument++)
+	{
+		for(uint32_t mode = 0; mode < 4; mode++)
+			if(!strcmp(argv[argument], presentNames[mode]))
+				presentRequest = presentModes[mode];
+		if(sscanf(argv[argument], "frames=%u", &framebufferLimit) == 1)
+			framebufferLimit = framebufferLimit < 1 ? 1 : framebufferLimit < FRAMES_MAXIMUM ? framebufferLimit :
+			 FRAMES_MAXIMUM;
+		benchmark |= !strcmp(argv[argument], "benchmark");
+		residency |= !strcmp(argv[argument], "residency");
+		memoryReport |= !strcmp(argv[argument], "memory");
+		churn |= !strcmp(argv[argument], "churn");
+		staging |= !strcmp(argv[argument], "staging");
+		sharedQueues |= !strcmp(argv[argument], "shared");
+		lowLatency |= !strcmp(argv[argument], "latency");
+		renderPasses |= !strcmp(argv[argument], "renderpass");
+	}
+
 	setup();
 	draw();
 	clean();
@@ -0,0 +1,143 @@
+// Tagged host allocations
+//
+// Every block is preceded by a header holding its size and tag, so live bytes,
+// peak bytes and allocation counts are kept per tag without a lookup table. The
+// header also carries a canary that catches frees of foreign or already freed
+// pointers. Scratch memory that only lives for one frame comes from a linear
+// arena that is reset wholesale at the start of the next frame. The statistics
+// are shared with the streaming threads, so they are only touched under a lock,
+// the arena belongs to the frame loop alone.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HOST_TAG_LIMIT 8
+#define HOST_CANARY 0x54534F48
+#define HOST_ALIGNMENT 16
+
+struct hostHeader
+{
+	size_t size;
+	uint32_t tag, canary;
+};
+
+struct hostStatistics
+{
+	size_t live, peak;
+	uint64_t count, total;
+};
+
+struct hostStatistics hostStatistics[HOST_TAG_LIMIT];
+pthread_mutex_t hostMutex = PTHREAD_MUTEX_INITIALIZER;
+uint8_t *hostArena;
+size_t hostArenaSize, hostArenaHead, hostArenaPeak;
+
+void failHost(const char *message)
+{
+	fprintf(stderr, "Host Memory: %s\n", message);
+	abort();
+}
+
+void countHost(uint32_t tag, size_t added, size_t removed, uint64_t allocated, uint64_t freed)
+{
+	pthread_mutex_lock(&hostMutex);
+	struct hostStatistics *statistics = &hostStatistics[tag];
+	statistics->live = statistics->live + added - removed;
+	statistics->peak = statistics->live > statistics->peak ? statistics->live : statistics->peak;
+	statistics->count = statistics->count + allocated - freed;
+	statistics->total += allocated;
+	pthread_mutex_unlock(&hostMutex);
+}
+
+void *trackHost(struct hostHeader *header, uint32_t tag, size_t size)
+{
+	if(!header)
+		failHost("Out of Memory");
+
+	*header = (struct hostHeader){size, tag, HOST_CANARY};
+	countHost(tag, size, 0, 1, 0);
+	return header + 1;
+}
+
+struct hostHeader *checkHost(void *pointer)
+{
+	struct hostHeader *header = (struct hostHeader*)pointer - 1;
+	if(header->canary != HOST_CANARY)
+		failHost("Foreign or Double Free");
+
+	return header;
+}
+
+struct hostHeader *untrackHost(void *pointer)
+{
+	struct hostHeader *header = checkHost(pointer);
+	countHost(header->tag, 0, header->size, 0, 1);
+	header->canary = 0;
+	return header;
+}
+
+void *allocateHost(uint32_t tag, size_t size)
+{
+	return trackHost(malloc(sizeof(struct hostHeader) + size), tag, size);
+}
+
+void *allocateHostZeroed(uint32_t tag, size_t count, size_t size)
+{
+	return trackHost(calloc(1, sizeof(struct hostHeader) + count * size), tag, count * size);
+}
+
+void *reallocateHost(uint32_t tag, void *pointer, size_t size)
+{
+	if(!pointer)
+		return allocateHost(tag, size);
+
+	// A resize is still the same allocation, so only the size delta is counted
+	struct hostHeader *header = checkHost(pointer);
+	size_t previous = header->size;
+	header = realloc(header, sizeof(struct hostHeader) + size);
+	if(!header)
+		failHost("Out of Memory");
+
+	header->size = size;
+	countHost(header->tag, size, previous, 0, 0);
+	return header + 1;
+}
+
+void freeHost(void *pointer)
+{
+	if(pointer)
+		free(untrackHost(pointer));
+}
+
+void createHostArena(uint32_t tag, size_t size)
+{
+	hostArena = allocateHost(tag, size);
+	hostArenaSize = size;
+	hostArenaHead = 0;
+}
+
+void *allocateArena(size_t size)
+{
+	size_t offset = (hostArenaHead + HOST_ALIGNMENT - 1) & ~(size_t)(HOST_ALIGNMENT - 1);
+	if(offset + size > hostArenaSize)
+		failHost("Frame Arena Exhausted");
+
+	hostArenaHead = offset + size;
+	hostArenaPeak = hostArenaHead > hostArenaPeak ? hostArenaHead : hostArenaPeak;
+	return hostArena + offset;
+}
+
+void resetHostArena()
+{
+	hostArenaHead = 0;
+}
+
+void destroyHostArena()
+{
+	freeHost(hostArena);
+	hostArena = NULL;
+	hostArenaSize = 0;
+}
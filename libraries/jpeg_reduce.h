@@ -0,0 +1,490 @@
+// Reduced resolution decoding for baseline JPEG files
+//
+// Only the top left size x size coefficients of every block are kept and
+// transformed with a size x size inverse DCT, where size = 8 / scale. Scale 8
+// is a DC only decode. The entropy decoder still walks every AC code, but the
+// transform, color conversion and output work shrink with the square of the
+// scale. Progressive, arithmetic coded, 12 bit and CMYK files return NULL so
+// the caller can fall back to a full decode.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JPEG_FAST 9
+
+// Define all three to route the decoder's allocations elsewhere
+#ifndef JPEG_MALLOC
+#define JPEG_MALLOC(size) malloc(size)
+#define JPEG_CALLOC(count, size) calloc(count, size)
+#define JPEG_FREE(pointer) free(pointer)
+#endif
+
+struct jpegHuffman
+{
+	uint16_t fast[1 << JPEG_FAST];
+	uint8_t values[256];
+	int32_t maxcode[18];
+	int32_t delta[17];
+};
+
+struct jpegComponent
+{
+	uint32_t id, h, v, quant, dc, ac;
+	int32_t prediction;
+	uint32_t width, height;
+	uint8_t *plane;
+};
+
+struct jpegDecoder
+{
+	const uint8_t *data;
+	size_t size, position;
+	uint64_t buffer;
+	int32_t count, marker;
+	uint16_t quant[4][64];
+	struct jpegHuffman dc[4], ac[4];
+	struct jpegComponent components[3];
+	uint32_t componentCount, width, height, hmax, vmax, restart;
+	float cosines[8][8];
+};
+
+static const uint8_t jpegZigzag[64] = {
+	 0,  1,  8, 16,  9,  2,  3, 10,
+	17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63};
+
+static uint32_t jpegWord(struct jpegDecoder *decoder)
+{
+	if(decoder->position + 2 > decoder->size)
+		return 0;
+	decoder->position += 2;
+	return decoder->data[decoder->position - 2] << 8 | decoder->data[decoder->position - 1];
+}
+
+static inline void jpegFill(struct jpegDecoder *decoder)
+{
+	while(decoder->count <= 56)
+	{
+		uint32_t byte = 0;
+
+		if(!decoder->marker && decoder->position < decoder->size)
+		{
+			byte = decoder->data[decoder->position++];
+
+			if(byte == 0xFF)
+			{
+				if(decoder->position < decoder->size && decoder->data[decoder->position] == 0x00)
+					decoder->position++;
+				else
+				{
+					decoder->marker = 1;
+					decoder->position--;
+					byte = 0;
+				}
+			}
+		}
+
+		decoder->buffer |= (uint64_t)byte << (56 - decoder->count);
+		decoder->count += 8;
+	}
+}
+
+static inline uint32_t jpegReceive(struct jpegDecoder *decoder, uint32_t bits)
+{
+	if(!bits)
+		return 0;
+
+	if(decoder->count < 16)
+		jpegFill(decoder);
+	uint32_t value = decoder->buffer >> (64 - bits);
+	decoder->buffer <<= bits;
+	decoder->count -= bits;
+	return value;
+}
+
+static inline int32_t jpegExtend(struct jpegDecoder *decoder, uint32_t bits)
+{
+	int32_t value = jpegReceive(decoder, bits);
+	return bits && value < (1 << (bits - 1)) ? value - (1 << bits) + 1 : value;
+}
+
+static inline int32_t jpegSymbol(struct jpegDecoder *decoder, struct jpegHuffman *huffman)
+{
+	if(decoder->count < 32)
+		jpegFill(decoder);
+	uint32_t entry = huffman->fast[decoder->buffer >> (64 - JPEG_FAST)];
+
+	if(entry)
+	{
+		decoder->buffer <<= entry >> 8;
+		decoder->count -= entry >> 8;
+		return entry & 0xFF;
+	}
+
+	for(uint32_t length = JPEG_FAST + 1; length <= 16; length++)
+	{
+		int32_t code = decoder->buffer >> (64 - length);
+		if(code < huffman->maxcode[length])
+		{
+			decoder->buffer <<= length;
+			decoder->count -= length;
+			return huffman->values[code + huffman->delta[length]];
+		}
+	}
+
+	return -1;
+}
+
+static int jpegTable(struct jpegHuffman *huffman, const uint8_t *counts, const uint8_t *values)
+{
+	int32_t code = 0, symbol = 0;
+	memset(huffman->fast, 0, sizeof(huffman->fast));
+
+	for(uint32_t length = 1; length <= 16; length++)
+	{
+		huffman->delta[length] = symbol - code;
+
+		for(uint32_t index = 0; index < counts[length - 1]; index++, symbol++, code++)
+		{
+			if(symbol > 255 || code >= 1 << length)
+				return 0;
+
+			huffman->values[symbol] = values[symbol];
+
+			if(length <= JPEG_FAST)
+				for(int32_t suffix = 0; suffix < 1 << (JPEG_FAST - length); suffix++)
+					huffman->fast[code << (JPEG_FAST - length) | suffix] = length << 8 | values[symbol];
+		}
+
+		huffman->maxcode[length] = code;
+		code <<= 1;
+	}
+
+	huffman->maxcode[17] = INT32_MAX;
+	return 1;
+}
+
+static int jpegBlock(struct jpegDecoder *decoder, struct jpegComponent *component, uint32_t size, float *block)
+{
+	uint16_t *quant = decoder->quant[component->quant];
+	int32_t symbol = jpegSymbol(decoder, &decoder->dc[component->dc]);
+	if(symbol < 0 || symbol > 15)
+		return 0;
+
+	memset(block, 0, size * size * sizeof(float));
+	component->prediction += jpegExtend(decoder, symbol);
+	block[0] = component->prediction * quant[0];
+
+	for(uint32_t index = 1; index < 64; index++)
+	{
+		if((symbol = jpegSymbol(decoder, &decoder->ac[component->ac])) < 0)
+			return 0;
+
+		uint32_t run = symbol >> 4, bits = symbol & 15;
+		if(!bits)
+		{
+			if(run != 15)
+				break;
+			index += 15;
+			continue;
+		}
+
+		if((index += run) > 63)
+			return 0;
+
+		uint32_t column = jpegZigzag[index] & 7, row = jpegZigzag[index] >> 3;
+		if(column < size && row < size)
+			block[row * size + column] = jpegExtend(decoder, bits) * quant[index];
+		else
+			jpegReceive(decoder, bits);
+	}
+
+	return 1;
+}
+
+static void jpegTransform(struct jpegDecoder *decoder, uint32_t size, float *block, uint8_t *output, uint32_t stride)
+{
+	if(size == 1)
+	{
+		float value = block[0] / 8.0f + 128.5f;
+		*output = value < 0.0f ? 0 : value > 255.0f ? 255 : value;
+		return;
+	}
+
+	float rows[64];
+
+	for(uint32_t row = 0; row < size; row++)
+	{
+		for(uint32_t x = 0; x < size; x++)
+		{
+			float sum = 0.0f;
+			for(uint32_t u = 0; u < size; u++)
+				sum += decoder->cosines[x][u] * block[row * size + u];
+			rows[row * size + x] = sum;
+		}
+	}
+
+	for(uint32_t y = 0; y < size; y++)
+	{
+		for(uint32_t x = 0; x < size; x++)
+		{
+			float value = 128.5f;
+			for(uint32_t v = 0; v < size; v++)
+				value += decoder->cosines[y][v] * rows[v * size + x];
+			output[y * stride + x] = value < 0.0f ? 0 : value > 255.0f ? 255 : value;
+		}
+	}
+}
+
+static int jpegScan(struct jpegDecoder *decoder, uint32_t size)
+{
+	uint32_t mcuWidth = (decoder->width + 8 * decoder->hmax - 1) / (8 * decoder->hmax);
+	uint32_t mcuHeight = (decoder->height + 8 * decoder->vmax - 1) / (8 * decoder->vmax);
+	float block[64];
+
+	for(uint32_t index = 0; index < decoder->componentCount; index++)
+	{
+		struct jpegComponent *component = &decoder->components[index];
+		component->width = mcuWidth * component->h * size;
+		component->height = mcuHeight * component->v * size;
+		component->plane = JPEG_MALLOC(component->width * component->height);
+		component->prediction = 0;
+	}
+
+	decoder->buffer = decoder->count = decoder->marker = 0;
+
+	for(uint32_t mcu = 0; mcu < mcuWidth * mcuHeight; mcu++)
+	{
+		if(decoder->restart && mcu && mcu % decoder->restart == 0)
+		{
+			decoder->buffer = decoder->count = decoder->marker = 0;
+			if(decoder->position + 1 < decoder->size && decoder->data[decoder->position] == 0xFF &&
+			 (decoder->data[decoder->position + 1] & 0xF8) == 0xD0)
+				decoder->position += 2;
+			for(uint32_t index = 0; index < decoder->componentCount; index++)
+				decoder->components[index].prediction = 0;
+		}
+
+		uint32_t mcuX = mcu % mcuWidth, mcuY = mcu / mcuWidth;
+
+		for(uint32_t index = 0; index < decoder->componentCount; index++)
+		{
+			struct jpegComponent *component = &decoder->components[index];
+
+			for(uint32_t blockY = 0; blockY < component->v; blockY++)
+			{
+				for(uint32_t blockX = 0; blockX < component->h; blockX++)
+				{
+					if(!jpegBlock(decoder, component, size, block))
+						return 0;
+
+					uint32_t x = (mcuX * component->h + blockX) * size, y = (mcuY * component->v + blockY) * size;
+					jpegTransform(decoder, size, block, component->plane + y * component->width + x, component->width);
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+static uint8_t *jpegOutput(struct jpegDecoder *decoder, uint32_t scale, int *width, int *height)
+{
+	uint32_t outputWidth = (decoder->width + scale - 1) / scale, outputHeight = (decoder->height + scale - 1) / scale;
+	uint8_t *pixels = JPEG_MALLOC(outputWidth * outputHeight * 4);
+
+	for(uint32_t y = 0; y < outputHeight; y++)
+	{
+		for(uint32_t x = 0; x < outputWidth; x++)
+		{
+			float samples[3];
+
+			for(uint32_t index = 0; index < decoder->componentCount; index++)
+			{
+				struct jpegComponent *component = &decoder->components[index];
+				samples[index] = component->plane[(y * component->v / decoder->vmax) * component->width +
+				 x * component->h / decoder->hmax];
+			}
+
+			uint8_t *pixel = pixels + (y * outputWidth + x) * 4;
+
+			if(decoder->componentCount == 1)
+				pixel[0] = pixel[1] = pixel[2] = samples[0];
+			else
+			{
+				float color[3] = {
+					samples[0] + 1.402f * (samples[2] - 128.0f) + 0.5f,
+					samples[0] - 0.344136f * (samples[1] - 128.0f) - 0.714136f * (samples[2] - 128.0f) + 0.5f,
+					samples[0] + 1.772f * (samples[1] - 128.0f) + 0.5f};
+
+				for(uint32_t channel = 0; channel < 3; channel++)
+					pixel[channel] = color[channel] < 0.0f ? 0 : color[channel] > 255.0f ? 255 : color[channel];
+			}
+
+			pixel[3] = 255;
+		}
+	}
+
+	*width = outputWidth;
+	*height = outputHeight;
+	return pixels;
+}
+
+static uint8_t *jpegDecode(struct jpegDecoder *decoder, uint32_t scale, int *width, int *height)
+{
+	uint32_t size = 8 / scale;
+
+	for(uint32_t x = 0; x < size; x++)
+		for(uint32_t u = 0; u < size; u++)
+			decoder->cosines[x][u] = (u ? sqrtf(2.0f / size) : sqrtf(1.0f / size)) * sqrtf(size / 8.0f) *
+			 cosf((2 * x + 1) * u * (float)M_PI / (2 * size));
+
+	if(jpegWord(decoder) != 0xFFD8)
+		return NULL;
+
+	while(decoder->position + 4 <= decoder->size)
+	{
+		if(decoder->data[decoder->position] != 0xFF)
+		{
+			decoder->position++;
+			continue;
+		}
+
+		uint32_t marker = jpegWord(decoder) & 0xFF;
+		if(marker == 0xFF || marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7))
+		{
+			decoder->position -= marker == 0xFF;
+			continue;
+		}
+
+		if(marker == 0xD9)
+			break;
+
+		size_t start = decoder->position, length = jpegWord(decoder);
+		if(length < 2 || start + length > decoder->size)
+			return NULL;
+		const uint8_t *segment = decoder->data + decoder->position;
+
+		if(marker == 0xC0 || marker == 0xC1)
+		{
+			if(segment[0] != 8 || (segment[5] != 1 && segment[5] != 3) || length < 8u + 3 * segment[5])
+				return NULL;
+
+			decoder->height = segment[1] << 8 | segment[2];
+			decoder->width = segment[3] << 8 | segment[4];
+			decoder->componentCount = segment[5];
+			decoder->hmax = decoder->vmax = 1;
+
+			for(uint32_t index = 0; index < decoder->componentCount; index++)
+			{
+				struct jpegComponent *component = &decoder->components[index];
+				component->id = segment[6 + 3 * index];
+				component->h = decoder->componentCount == 1 ? 1 : segment[7 + 3 * index] >> 4;
+				component->v = decoder->componentCount == 1 ? 1 : segment[7 + 3 * index] & 15;
+				component->quant = segment[8 + 3 * index] & 3;
+				if(!component->h || !component->v || component->h > 4 || component->v > 4)
+					return NULL;
+				decoder->hmax = component->h > decoder->hmax ? component->h : decoder->hmax;
+				decoder->vmax = component->v > decoder->vmax ? component->v : decoder->vmax;
+			}
+
+			if(!decoder->width || !decoder->height)
+				return NULL;
+		}
+
+		else if((marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC))
+			return NULL;
+
+		else if(marker == 0xC4)
+		{
+			for(size_t offset = 0; offset + 17 <= length - 2;)
+			{
+				uint32_t class = segment[offset] >> 4, table = segment[offset] & 3, total = 0;
+				for(uint32_t index = 0; index < 16; index++)
+					total += segment[offset + 1 + index];
+				if(class > 1 || total > 256 || offset + 17 + total > length - 2 ||
+				 !jpegTable(class ? &decoder->ac[table] : &decoder->dc[table], segment + offset + 1, segment + offset + 17))
+					return NULL;
+				offset += 17 + total;
+			}
+		}
+
+		else if(marker == 0xDB)
+		{
+			for(size_t offset = 0; offset < length - 2;)
+			{
+				uint32_t precision = segment[offset] >> 4, table = segment[offset] & 3;
+				if(offset + 1 + 64 * (precision + 1) > length - 2)
+					return NULL;
+				for(uint32_t index = 0; index < 64; index++)
+					decoder->quant[table][index] = precision ? segment[offset + 1 + 2 * index] << 8 |
+					 segment[offset + 2 + 2 * index] : segment[offset + 1 + index];
+				offset += 1 + 64 * (precision + 1);
+			}
+		}
+
+		else if(marker == 0xDD)
+			decoder->restart = segment[0] << 8 | segment[1];
+
+		else if(marker == 0xDA)
+		{
+			if(!decoder->componentCount || segment[0] != decoder->componentCount)
+				return NULL;
+
+			for(uint32_t index = 0; index < decoder->componentCount; index++)
+			{
+				if(segment[1 + 2 * index] != decoder->components[index].id)
+					return NULL;
+				decoder->components[index].dc = segment[2 + 2 * index] >> 4 & 3;
+				decoder->components[index].ac = segment[2 + 2 * index] & 3;
+			}
+
+			decoder->position = start + length;
+			if(!jpegScan(decoder, size))
+				return NULL;
+			return jpegOutput(decoder, scale, width, height);
+		}
+
+		decoder->position = start + length;
+	}
+
+	return NULL;
+}
+
+uint8_t *loadReducedJpeg(const char *path, uint32_t scale, int *width, int *height)
+{
+	if(scale != 1 && scale != 2 && scale != 4 && scale != 8)
+		return NULL;
+
+	FILE *file = fopen(path, "rb");
+	if(!file)
+		return NULL;
+
+	fseek(file, 0, SEEK_END);
+	size_t size = ftell(file);
+	rewind(file);
+
+	uint8_t *data = JPEG_MALLOC(size);
+	size_t read = fread(data, 1, size, file);
+	fclose(file);
+
+	struct jpegDecoder *decoder = JPEG_CALLOC(1, sizeof(struct jpegDecoder));
+	decoder->data = data;
+	decoder->size = read;
+
+	uint8_t *pixels = read == size ? jpegDecode(decoder, scale, width, height) : NULL;
+
+	for(uint32_t index = 0; index < decoder->componentCount; index++)
+		JPEG_FREE(decoder->components[index].plane);
+	JPEG_FREE(decoder);
+	JPEG_FREE(data);
+	return pixels;
+}
@@ -1,14 +1,103 @@
 #version 460
 #extension GL_ARB_separate_shader_objects: enable
 
+// Keep in sync with VIRTUAL_PAGE, VIRTUAL_BORDER, VIRTUAL_SLOTS, FEEDBACK_SCALE and RESIDENCY_LEVELS in engine.c
+const int virtualPage = 128;
+const int virtualBorder = 4;
+const int virtualSlot = virtualPage + 2 * virtualBorder;
+const int virtualAtlas = 16 * virtualSlot;
+const int feedbackScale = 8;
+const uint residencyLevels = 32;
+
+layout(binding = 0) uniform UniformBufferObject
+{
+	mat4 model;
+	mat4 view;
+	mat4 proj;
+	uvec4 feedback;
+	uvec4 residency;
+} ubo;
+
 layout(binding = 1) uniform sampler2D texSampler;
+layout(binding = 2) uniform usampler2D pageTable;
+layout(binding = 3) uniform sampler2D pageAtlas;
+
+layout(binding = 4) buffer FeedbackBuffer
+{
+	uint requests[];
+} feedback;
+
+layout(binding = 5) uniform sampler2DArray packedAtlas;
+
+struct ObjectBufferObject
+{
+	uint mode;
+	uint layer;
+};
+
+// Indexed by mesh slot, which reaches the shaders as the first instance of each draw
+layout(binding = 6) readonly buffer ObjectBuffer
+{
+	ObjectBufferObject objects[];
+};
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexture;
+layout(location = 2) flat in uint fragObject;
 
 layout(location = 0) out vec4 outColor;
 
+void requestResidency(uint index, float lod)
+{
+	uvec2 fragment = uvec2(gl_FragCoord.xy);
+	if(ubo.residency.z != 0 &&
+	 fragment % feedbackScale == uvec2(ubo.feedback.y % feedbackScale, ubo.feedback.y / feedbackScale))
+	{
+		uint slot = ubo.residency.w + 2 * index;
+		atomicMax(feedback.requests[slot], residencyLevels - uint(clamp(lod, 0.0, residencyLevels - 1.0)));
+		atomicAdd(feedback.requests[slot + 1], 1);
+	}
+}
+
+vec4 sampleVirtual(vec2 coordinate)
+{
+	uint pages = ubo.feedback.z;
+	vec2 texel = coordinate * float(pages * virtualPage);
+	vec2 dx = dFdx(texel), dy = dFdy(texel);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+
+	uint level = min(uint(lod), ubo.feedback.w - 1);
+	vec2 wrapped = fract(coordinate);
+	uvec2 page = min(uvec2(wrapped * float(pages >> level)), uvec2((pages >> level) - 1));
+
+	uvec2 fragment = uvec2(gl_FragCoord.xy);
+	if(fragment % feedbackScale == uvec2(ubo.feedback.y % feedbackScale, ubo.feedback.y / feedbackScale))
+	{
+		// A slot that hasn't resized its buffer yet can render a larger frame than the buffer covers
+		uvec2 cell = fragment / feedbackScale;
+		if(cell.x < ubo.feedback.x && cell.y * ubo.feedback.x + cell.x < ubo.residency.w)
+			feedback.requests[cell.y * ubo.feedback.x + cell.x] = (level << 24 | page.y << 12 | page.x) + 1;
+	}
+
+	uvec4 entry = texelFetch(pageTable, ivec2(page), int(level));
+	vec2 local = fract(wrapped * float(pages >> entry.b));
+	vec2 position = vec2(entry.rg) * virtualSlot + virtualBorder + local * virtualPage;
+	return textureLod(pageAtlas, position / virtualAtlas, 0.0);
+}
+
 void main()
 {
-	outColor = texture(texSampler, fragTexture);
+	ObjectBufferObject object = objects[fragObject];
+	if(object.mode == 1)
+		outColor = sampleVirtual(fragTexture);
+	else if(object.mode == 2)
+	{
+		requestResidency(1, textureQueryLod(packedAtlas, fragTexture).y + ubo.residency.y);
+		outColor = texture(packedAtlas, vec3(fragTexture, object.layer));
+	}
+	else
+	{
+		requestResidency(0, textureQueryLod(texSampler, fragTexture).y + ubo.residency.x);
+		outColor = texture(texSampler, fragTexture);
+	}
 }
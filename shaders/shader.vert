@@ -6,6 +6,8 @@ layout(binding = 0) uniform UniformBufferObject
 	mat4 model;
 	mat4 view;
 	mat4 proj;
+	uvec4 feedback;
+	uvec4 residency;
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
@@ -14,10 +16,12 @@ layout(location = 2) in vec2 inTexture;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexture;
+layout(location = 2) flat out uint fragObject;
 
 void main()
 {
 	gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
 	fragColor = inColor;
 	fragTexture = inTexture;
+	fragObject = gl_InstanceIndex;
 }